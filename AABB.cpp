@@ -7,7 +7,9 @@
  * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
  */
 
+#include <algorithm>
 #include "AABB.h"
+#include "RayPacket.h"
 
 /*
 bool AABB::hit(const Ray& r, double tmin, double tmax) const
@@ -42,6 +44,38 @@ bool AABB::hit(const Ray& r, double tmin, double tmax) const
     return true;
 }
 
+AABB::PacketOverlap AABB::overlap(const RayPacket& packet, double tmin, double tmaxLow, double tmaxHigh) const
+{
+    // Bounds of the slab distances hit() computes, over every ray.  Rounding
+    // is monotonic, so the bounds of the computed values follow from the
+    // computed values at the interval ends.
+    double nearLow = tmin, nearHigh = tmin;
+    double farLow = tmaxLow, farHigh = tmaxHigh;
+    for (int a = 0; a < 3; a++)
+    {
+        const double invMin = packet.invDirMin[a];
+        const double invMax = packet.invDirMax[a];
+        double range[2][2];
+        for (int side = 0; side < 2; side++)
+        {
+            const double plane = side ? m_max[a] : m_min[a];
+            const double lo = plane - packet.originMax[a];
+            const double hi = plane - packet.originMin[a];
+            const double c0 = lo * invMin, c1 = lo * invMax, c2 = hi * invMin, c3 = hi * invMax;
+            range[side][0] = std::min(std::min(c0, c1), std::min(c2, c3));
+            range[side][1] = std::max(std::max(c0, c1), std::max(c2, c3));
+        }
+        const int nearSide = (invMin < 0.0) ? 1 : 0;
+        nearLow = std::max(nearLow, range[nearSide][0]);
+        nearHigh = std::max(nearHigh, range[nearSide][1]);
+        farLow = std::min(farLow, range[1 - nearSide][0]);
+        farHigh = std::min(farHigh, range[1 - nearSide][1]);
+        if (farHigh <= nearLow)
+            return PacketOverlap::None;
+    }
+    return (nearHigh < farLow) ? PacketOverlap::All : PacketOverlap::Some;
+}
+
 AABB AABB::join(const AABB& box0, const AABB& box1)
 {
     Vector3 small(fmin(box0.min().x(), box1.min().x()),
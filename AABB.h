@@ -13,6 +13,8 @@
 #include "Vector3.h"
 #include "Ray.h"
 
+struct RayPacket;
+
 class AABB
 {
 public:
@@ -27,6 +29,17 @@ public:
 
     bool hit(const Ray& r, double tmin, double tmax) const;
 
+    enum class PacketOverlap
+    {
+        None,   // hit() is false for every ray
+        Some,   // either way
+        All     // hit() is true for every ray
+    };
+
+    // Interval test of a coherent packet against the box, for rays whose own
+    // tmax lies in [tmaxLow, tmaxHigh].
+    PacketOverlap overlap(const RayPacket& packet, double tmin, double tmaxLow, double tmaxHigh) const;
+
     static AABB join(const AABB& box0, const AABB& box1);
 
 protected:
@@ -0,0 +1,68 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_ANIMATION_H
+#define PATHTRACER_ANIMATION_H
+
+#include <algorithm>
+#include <vector>
+#include "Vector3.h"
+
+inline double interpolate(double a, double b, double s)
+{
+    return a + s * (b - a);
+}
+
+inline Vector3 interpolate(const Vector3& a, const Vector3& b, double s)
+{
+    return a + s * (b - a);
+}
+
+//
+// A value keyframed over the frames of an animation: linear between keys,
+// held before the first key and after the last.  The value type needs an
+// interpolate() overload.
+//
+template <typename T>
+class Track
+{
+public:
+    // Keys are added in increasing frame order.
+    void add(double frame, const T& value)
+    {
+        m_keys.push_back({frame, value});
+    }
+
+    bool empty() const { return m_keys.empty(); }
+
+    double lastFrame() const { return m_keys.back().frame; }
+
+    T at(double frame) const
+    {
+        if (frame <= m_keys.front().frame)
+            return m_keys.front().value;
+        if (frame >= m_keys.back().frame)
+            return m_keys.back().value;
+        auto next = std::upper_bound(m_keys.begin(), m_keys.end(), frame,
+                                     [](double f, const Key& key) { return f < key.frame; });
+        auto prev = next - 1;
+        return interpolate(prev->value, next->value, (frame - prev->frame) / (next->frame - prev->frame));
+    }
+
+private:
+    struct Key
+    {
+        double frame;
+        T value;
+    };
+
+    std::vector<Key> m_keys;
+};
+
+#endif //PATHTRACER_ANIMATION_H
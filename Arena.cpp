@@ -0,0 +1,93 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <cstdint>
+#include "Arena.h"
+#include "ThreadPool.h"
+
+Arena::Arena(size_t blockSize) :
+    m_blockSize(blockSize)
+{
+    const int numRegions = ThreadPool::instance().numThreads();
+    for (int i = 0; i < numRegions; i++)
+        m_regions.emplace_back(new Region());
+}
+
+Arena::~Arena()
+{
+    release();
+}
+
+Arena::Region& Arena::region()
+{
+    return *m_regions[size_t(ThreadPool::threadIndex()) % m_regions.size()];
+}
+
+void* Arena::allocate(size_t size, size_t alignment)
+{
+    Region& r = region();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.used += size;
+
+    // Anything too large to share a block gets one of its own, leaving the
+    // current block to the small objects around it.
+    if (size + alignment > m_blockSize / 4)
+    {
+        char* block = static_cast<char*>(::operator new(size + alignment));
+        r.blocks.push_back(block);
+        return block + (alignment - uintptr_t(block) % alignment) % alignment;
+    }
+
+    auto p = reinterpret_cast<uintptr_t>(r.next);
+    p += (alignment - p % alignment) % alignment;
+    if (r.next == nullptr || p + size > reinterpret_cast<uintptr_t>(r.end))
+    {
+        r.next = static_cast<char*>(::operator new(m_blockSize));
+        r.end = r.next + m_blockSize;
+        r.blocks.push_back(r.next);
+        p = reinterpret_cast<uintptr_t>(r.next);
+        p += (alignment - p % alignment) % alignment;
+    }
+    r.next = reinterpret_cast<char*>(p + size);
+    return reinterpret_cast<void*>(p);
+}
+
+void Arena::onRelease(void (*cleanup)(void*), void* data)
+{
+    Region& r = region();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.cleanups.push_back(Cleanup{cleanup, data});
+}
+
+void Arena::release()
+{
+    for (auto& r : m_regions)
+    {
+        std::lock_guard<std::mutex> lock(r->mutex);
+        for (auto c = r->cleanups.rbegin(); c != r->cleanups.rend(); ++c)
+            c->function(c->data);
+        for (void* block : r->blocks)
+            ::operator delete(block);
+        r->cleanups.clear();
+        r->blocks.clear();
+        r->next = r->end = nullptr;
+        r->used = 0;
+    }
+}
+
+size_t Arena::bytesAllocated() const
+{
+    size_t total = 0;
+    for (auto& r : m_regions)
+    {
+        std::lock_guard<std::mutex> lock(r->mutex);
+        total += r->used;
+    }
+    return total;
+}
@@ -0,0 +1,86 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_ARENA_H
+#define PATHTRACER_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//
+// Bump allocator that owns the objects of a scene.
+//
+// Objects are placed one after another in large blocks, in the order they are
+// made, so a BVH node sits next to its children and a list next to its
+// elements.  Each pool thread allocates from its own region, so the subtrees
+// of a parallel BVH build stay contiguous and the threads never contend.
+//
+// Nothing is freed until release(), which frees the whole scene at once: the
+// destructors of the few objects that own memory of their own (lists, light
+// trees) run, and the blocks are returned.  Trivially destructible objects,
+// most of a scene, cost nothing at teardown.
+//
+class Arena
+{
+public:
+    explicit Arena(size_t blockSize = size_t(1) << 20u);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment);
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible<T>::value)
+            onRelease([](void* p) { static_cast<T*>(p)->~T(); }, object);
+        return object;
+    }
+
+    // Run cleanup(data) at release(), for memory the scene holds that was
+    // not allocated here (decoded images).
+    void onRelease(void (*cleanup)(void*), void* data);
+
+    // Destroys everything made so far.  The arena can be reused afterwards.
+    void release();
+
+    size_t bytesAllocated() const;
+
+private:
+    struct Cleanup
+    {
+        void (*function)(void*);
+        void* data;
+    };
+
+    struct alignas(64) Region
+    {
+        std::mutex mutex;
+        char* next = nullptr;
+        char* end = nullptr;
+        size_t used = 0;
+        std::vector<void*> blocks;
+        std::vector<Cleanup> cleanups;
+    };
+
+    Region& region();
+
+    size_t m_blockSize;
+    std::vector<std::unique_ptr<Region>> m_regions;
+};
+
+#endif //PATHTRACER_ARENA_H
@@ -8,37 +8,110 @@
  */
 
 #include <algorithm>
+#include <cfloat>
 #include "BVH.h"
+#include "Sampler.h"
+#include "ThreadPool.h"
 
-bool BVH::hit(const Ray &r, double tmin, double tmax, HitRecord &rec) const
+// Packets down to this many rays are traced one ray at a time.
+static const int PACKET_DIVERGED = 4;
+
+static int countRays(uint64_t mask)
+{
+    int n = 0;
+    for (; mask != 0; mask &= mask - 1)
+        n++;
+    return n;
+}
+
+// Subtrees at least this large are built as separate pool tasks.
+static const size_t PARALLEL_BUILD_SIZE = 512;
+
+// Random numbers drawn building a node over n hitables, one per node.
+static uint64_t buildDraws(size_t n)
+{
+    if (n <= 2)
+        return 1;
+    return 1 + buildDraws(n / 2) + buildDraws(n - n / 2);
+}
+
+bool BVH::intersect(const Ray &r, double tmin, double tmax, SurfaceHit &hit) const
 {
     if (m_bbox.hit(r, tmin, tmax))
     {
-        HitRecord leftRec, rightRec;
-        bool hitLeft = left->hit(r, tmin, tmax, leftRec);
-        bool hitRight = right->hit(r, tmin, tmax, rightRec);
-        if (hitLeft && hitRight)
+        // The left child's hit goes straight to 'hit'; on a tie the right one
+        // is taken.
+        SurfaceHit rightHit;
+        bool hitLeft = left->intersect(r, tmin, tmax, hit);
+        bool hitRight = right->intersect(r, tmin, tmax, rightHit);
+        if (hitRight && !(hitLeft && hit.t < rightHit.t))
+            hit = rightHit;
+        return hitLeft || hitRight;
+    }
+    return false;
+}
+
+//
+// The rays of a packet that enter the node's box go down both children
+// together, so the children are visited once per packet rather than once per
+// ray.  For a coherent packet one interval test finds when the box is missed
+// or entered by every ray, without testing the rays one by one.  The results
+// match intersect() ray for ray.
+//
+uint64_t BVH::intersectPacket(const RayPacket& packet, uint64_t active, double tmin, const double* tmax,
+                              SurfaceHit* hits) const
+{
+    AABB::PacketOverlap overlap = AABB::PacketOverlap::Some;
+    if (packet.coherent)
+    {
+        double minT = DBL_MAX, maxT = tmin;
+        for (uint64_t m = active; m != 0; m &= m - 1)
         {
-            if (leftRec.t < rightRec.t)
-                rec = leftRec;
-            else
-                rec = rightRec;
-            return true;
+            const int i = RayPacket::firstRay(m);
+            minT = std::min(minT, tmax[i]);
+            maxT = std::max(maxT, tmax[i]);
         }
-        else if (hitLeft)
+        overlap = m_bbox.overlap(packet, tmin, minT, maxT);
+        if (overlap == AABB::PacketOverlap::None)
+            return 0;
+    }
+
+    uint64_t inside = active;
+    if (overlap != AABB::PacketOverlap::All)
+    {
+        for (uint64_t m = active; m != 0; m &= m - 1)
         {
-            rec = leftRec;
-            return true;
+            const int i = RayPacket::firstRay(m);
+            if (!m_bbox.hit(packet.rays[i], tmin, tmax[i]))
+                inside &= ~RayPacket::bit(i);
         }
-        else if (hitRight)
+        if (inside == 0)
+            return 0;
+    }
+
+    if ((inside & (inside - 1)) == 0 || countRays(inside) <= PACKET_DIVERGED)
+    {
+        // Too few rays left to be worth carrying as a packet.
+        uint64_t hitMask = 0;
+        for (uint64_t m = inside; m != 0; m &= m - 1)
         {
-            rec = rightRec;
-            return true;
+            const int i = RayPacket::firstRay(m);
+            if (intersect(packet.rays[i], tmin, tmax[i], hits[i]))
+                hitMask |= RayPacket::bit(i);
         }
-        else
-            return false;
+        return hitMask;
     }
-    return false;
+
+    SurfaceHit rightHits[RayPacket::MAX_RAYS];
+    const uint64_t hitLeft = left->intersectPacket(packet, inside, tmin, tmax, hits);
+    const uint64_t hitRight = right->intersectPacket(packet, inside, tmin, tmax, rightHits);
+    for (uint64_t m = hitRight; m != 0; m &= m - 1)
+    {
+        const int i = RayPacket::firstRay(m);
+        if (!((hitLeft & RayPacket::bit(i)) && hits[i].t < rightHits[i].t))
+            hits[i] = rightHits[i];
+    }
+    return hitLeft | hitRight;
 }
 
 bool BVH::bounds(double t0, double t1, AABB &bbox) const
@@ -47,9 +120,15 @@ bool BVH::bounds(double t0, double t1, AABB &bbox) const
     return true;
 }
 
-BVH::BVH(std::vector<Hitable *> &list, double time0, double time1)
+BVH::BVH(std::vector<Hitable *> &list, double time0, double time1, Arena& arena)
 {
-    auto axis = int(3 * drand48());
+    Random rng(list.size());
+    *this = BVH(list, time0, time1, rng, arena);
+}
+
+BVH::BVH(std::vector<Hitable *> &list, double time0, double time1, Random& rng, Arena& arena)
+{
+    auto axis = int(3 * rng.nextDouble());
     if (axis == 0)
     {
         auto boxXCompare = [](Hitable* a, Hitable* b)->bool
@@ -96,9 +175,27 @@ BVH::BVH(std::vector<Hitable *> &list, double time0, double time1)
     else
     {
         auto leftNodes = std::vector<Hitable*>(list.begin(), list.begin()+n/2);
-        left = new BVH(leftNodes, time0, time1);
         auto rightNodes = std::vector<Hitable*>(list.begin()+n/2, list.end());
-        right = new BVH(rightNodes, time0, time1);
+        if (n >= PARALLEL_BUILD_SIZE)
+        {
+            // The right subtree starts where the left one's random numbers
+            // end, so the tree, and the numbers left in rng for the rest of
+            // the scene, match a serial build.
+            Random rightRng = rng;
+            rightRng.advance(buildDraws(leftNodes.size()));
+
+            ThreadPool& pool = ThreadPool::instance();
+            ThreadPool::TaskGroup group;
+            pool.run(group, [&]() { left = arena.make<BVH>(leftNodes, time0, time1, rng, arena); });
+            right = arena.make<BVH>(rightNodes, time0, time1, rightRng, arena);
+            pool.wait(group);
+            rng = rightRng;
+        }
+        else
+        {
+            left = arena.make<BVH>(leftNodes, time0, time1, rng, arena);
+            right = arena.make<BVH>(rightNodes, time0, time1, rng, arena);
+        }
     }
     AABB boxLeft, boxRight;
     if (!left->bounds(time0, time1, boxLeft) || !right->bounds(time0, time1, boxRight))
@@ -114,10 +211,28 @@ double BVH::pdfValue(const Vector3& o, const Vector3& v) const
     return sum;
 }
 
-Vector3 BVH::random(const Vector3& o) const
+Vector3 BVH::random(const Vector3& o, Sampler& sampler) const
 {
-    if (drand48() < 0.5)
-        return left->random(o);
+    if (sampler.get1D() < 0.5)
+        return left->random(o, sampler);
     else
-        return right->random(o);
+        return right->random(o, sampler);
+}
+
+bool BVH::setFrame(double frame)
+{
+    if (!m_animated)
+        return false;
+    const bool leftAnimated = left->setFrame(frame);
+    const bool rightAnimated = (right != left) && right->setFrame(frame);
+    m_animated = leftAnimated || rightAnimated;
+    if (m_animated)
+    {
+        AABB boxLeft, boxRight;
+        left->bounds(0, 1, boxLeft);
+        right->bounds(0, 1, boxRight);
+        m_bbox = AABB::join(boxLeft, boxRight);
+    }
+    return m_animated;
 }
+
@@ -13,28 +13,53 @@
 #include <vector>
 #include "Hitable.h"
 #include "AABB.h"
+#include "Random.h"
 
 class BVH : public Hitable
 {
 public:
     BVH() = default;
 
-    BVH(std::vector<Hitable*>& list, double time0, double time1);
+    BVH(std::vector<Hitable*>& list, double time0, double time1, Arena& arena);
 
-    bool hit(const Ray& r, double tmin, double tmax, HitRecord& rec) const override;
+    BVH(std::vector<Hitable*>& list, double time0, double time1, Random& rng, Arena& arena);
+
+    // A node already built, as loaded from a scene package.
+    BVH(Hitable* l, Hitable* r, const AABB& bbox) :
+        left(l),
+        right(r),
+        m_bbox(bbox) { }
+
+    bool intersect(const Ray& r, double tmin, double tmax, SurfaceHit& hit) const override;
+
+    uint64_t intersectPacket(const RayPacket& packet, uint64_t active, double tmin, const double* tmax,
+                             SurfaceHit* hits) const override;
 
     bool bounds(double t0, double t1, AABB& bbox) const override;
 
     double pdfValue(const Vector3& o, const Vector3& v) const override;
 
-    Vector3 random(const Vector3& o) const override;
+    Vector3 random(const Vector3& o, Sampler& sampler) const override;
+
+    void collectLights(std::vector<Hitable*>& lights, const MaterialTable& materials, Arena& arena) override
+    {
+        left->collectLights(lights, materials, arena);
+        if (right != left)
+            right->collectLights(lights, materials, arena);
+    }
 
     int numChildren() const override
     { return 2 + left->numChildren() + right->numChildren(); }
 
+    // Refits the boxes above the animated nodes; the tree is not rebuilt.
+    bool setFrame(double frame) override;
+
     Hitable* left{};
     Hitable* right{};
     AABB m_bbox{};
+
+    // Until a frame finds nothing animated below.
+    bool m_animated = true;
 };
 
 
@@ -13,6 +13,7 @@
 #include "Vector3.h"
 #include "Ray.h"
 #include "Material.h"
+#include "Animation.h"
 
 class Camera
 {
@@ -23,7 +24,8 @@ public:
         origin(0, 0, 0),
         lowerLeftCorner(),
         horizontal(),
-        vertical()
+        vertical(),
+        aspectRatio(aspect)
     {
         double theta = vfov * M_PI / 180;
         double halfHeight = tan(theta / 2);
@@ -40,7 +42,8 @@ public:
         horizontal(),
         vertical(),
         time0(t0),
-        time1(t1)
+        time1(t1),
+        aspectRatio(aspect)
     {
         lens_radius = aperture / 2;
         double theta = vfov * M_PI / 180;
@@ -54,11 +57,32 @@ public:
         vertical = 2 * halfHeight * focal_dist * v;
     }
 
-    Ray getRay(double s, double t)
+    // Angle between the rays through neighboring pixels at the center of an
+    // image 'height' pixels high: how fast a ray's cone of the pixel widens.
+    double pixelSpread(int height) const
     {
-        Vector3 rd = lens_radius * randomInUnitDisk();
+        const double distance = (lowerLeftCorner + 0.5 * horizontal + 0.5 * vertical - origin).length();
+        return (distance > 0) ? vertical.length() / (distance * height) : 0;
+    }
+
+    // Widens or narrows the view for another image shape, keeping the
+    // vertical field of view and the direction of view.
+    void setAspect(double aspect)
+    {
+        if (aspect == aspectRatio)
+            return;
+        const Vector3 center = lowerLeftCorner + 0.5 * horizontal + 0.5 * vertical;
+        horizontal *= aspect / aspectRatio;
+        lowerLeftCorner = center - 0.5 * horizontal - 0.5 * vertical;
+        aspectRatio = aspect;
+    }
+
+    Ray getRay(double s, double t, Sampler& sampler) const
+    {
+        sampler.setDimension(SampleDim::Lens);
+        Vector3 rd = lens_radius * randomInUnitDisk(sampler);
         Vector3 offset = u * rd.x() + v * rd.y();
-        double time = time0 + drand48() * (time1 - time0);
+        double time = time0 + sampler.get1D() * (time1 - time0);
         return Ray(origin + offset, lowerLeftCorner + s * horizontal + t * vertical - origin - offset, time);
     }
 
@@ -70,6 +94,38 @@ private:
     Vector3 u{}, v{}, w{};
     double time0{}, time1{};
     double lens_radius{};
+    double aspectRatio = 1;
+};
+
+// The settings of a camera keyframe, see CameraPath.
+struct CameraKey
+{
+    Vector3 from, at, up;
+    double fov;
+    double aperture;
+    double focus;
+};
+
+inline CameraKey interpolate(const CameraKey& a, const CameraKey& b, double s)
+{
+    return {interpolate(a.from, b.from, s), interpolate(a.at, b.at, s), interpolate(a.up, b.up, s),
+            interpolate(a.fov, b.fov, s), interpolate(a.aperture, b.aperture, s), interpolate(a.focus, b.focus, s)};
+}
+
+//
+// A camera moving over the frames of an animation.  Scenes without one keep
+// the camera they set up.
+//
+struct CameraPath
+{
+    Camera at(double frame, double aspect) const
+    {
+        const CameraKey key = keys.at(frame);
+        return {key.from, key.at, key.up, key.fov, aspect, key.aperture, key.focus, time0, time1};
+    }
+
+    Track<CameraKey> keys;
+    double time0 = 0, time1 = 1;
 };
 
 #endif //PATHTRACER_CAMERA_H
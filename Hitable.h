@@ -10,28 +10,140 @@
 #ifndef PATHTRACER_HITABLE_H
 #define PATHTRACER_HITABLE_H
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
 #include "Vector3.h"
 #include "Ray.h"
+#include "RayPacket.h"
 #include "Vector2.h"
+#include "Arena.h"
 
-class Material;
+// Index of a material in the scene's MaterialTable, see Material.h.
+typedef uint32_t MaterialId;
 
 class AABB;
 
+class MaterialTable;
+
+class Sampler;
+
+class Hitable;
+
 struct HitRecord
 {
     double t{};
     Vector3 p{};
     Vector3 normal{};
-    Material *material{};
+    MaterialId material{};
     Vector2 uv;
+
+    // Rates of change of u and v per unit of distance over the surface, set
+    // by primitives whose textures are filtered; zero otherwise.
+    Vector2 uvDensity{0, 0};
+
+    // Extent in u and v of the area around the hit the texture lookups stand
+    // for, see setFootprint().
+    Vector2 footprint{0, 0};
+
+    // The footprint of a ray cone 'coneWidth' across where it meets the
+    // surface.  It is stretched by the slant of the surface, but at most 4x,
+    // as lookups filter the same amount in every direction.
+    void setFootprint(const Ray& r, double coneWidth)
+    {
+        const double cosine = std::fabs(dot(r.direction(), normal)) / r.direction().length();
+        const double width = coneWidth / std::max(cosine, 0.25);
+        footprint = Vector2(width * uvDensity.u(), width * uvDensity.v());
+    }
+};
+
+//
+// Intersection found during traversal: the distance, the primitive hit and
+// where on it, and the instances (Translate, RotateY) the ray went through to
+// reach it, innermost first.  Most candidates are beaten by a closer one, so
+// the full HitRecord is only evaluated, by evaluate(), for the closest.
+//
+struct SurfaceHit
+{
+    // Nesting of instances a hit can record.  The scene parser and package
+    // loader reject deeper scenes; built-in scenes stay within it.
+    static const int MAX_INSTANCES = 4;
+
+    // Called by a primitive for a hit at distance t, with any parameters its
+    // surface() needs to place the hit (barycentrics for a triangle).
+    void set(const Hitable* hitPrimitive, double hitT, double hitU = 0, double hitV = 0)
+    {
+        t = hitT;
+        u = hitU;
+        v = hitV;
+        primitive = hitPrimitive;
+        numInstances = 0;
+        flipNormal = false;
+    }
+
+    void pushInstance(const Hitable* instance)
+    {
+        assert(numInstances < MAX_INSTANCES);
+        instances[numInstances++] = instance;
+    }
+
+    // Fills rec for this hit along r, the ray given to the outermost intersect().
+    void evaluate(const Ray& r, HitRecord& rec) const;
+
+    double t;
+    double u, v;
+    const Hitable* primitive;
+    const Hitable* instances[MAX_INSTANCES];
+    int numInstances;
+    bool flipNormal;
 };
 
 class Hitable
 {
 public:
 
-    virtual bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const = 0;
+    // Closest intersection with t in (t_min, t_max).  'hit' is only written
+    // when there is one, so it can carry a closer hit found elsewhere.
+    virtual bool intersect(const Ray& r, double t_min, double t_max, SurfaceHit& hit) const = 0;
+
+    // Surface of a hit on this primitive found by intersect(), r being the ray
+    // as the primitive saw it.
+    virtual void surface(const Ray& r, const SurfaceHit& hit, HitRecord& rec) const { }
+
+    // For instances: the ray in the space of the instanced hitable, and a
+    // record from that space back to this one.
+    virtual Ray rayToInstance(const Ray& r) const
+    {
+        return r;
+    }
+    virtual void recordFromInstance(HitRecord& rec) const { }
+
+    // The closest intersection and its surface.
+    bool hit(const Ray& r, double t_min, double t_max, HitRecord& rec) const
+    {
+        SurfaceHit surfaceHit;
+        if (!intersect(r, t_min, t_max, surfaceHit))
+            return false;
+        surfaceHit.evaluate(r, rec);
+        return true;
+    }
+
+    // intersect() for the rays of 'active', each with its own t_max, writing
+    // hits[i] only for the rays that hit.  Returns the mask of those rays.  Nodes that can cull whole packets override
+    // it; everything else traces one ray at a time.
+    virtual uint64_t intersectPacket(const RayPacket& packet, uint64_t active, double t_min, const double* t_max,
+                                     SurfaceHit* hits) const
+    {
+        uint64_t hitMask = 0;
+        for (uint64_t m = active; m != 0; m &= m - 1)
+        {
+            const int i = RayPacket::firstRay(m);
+            if (intersect(packet.rays[i], t_min, t_max[i], hits[i]))
+                hitMask |= RayPacket::bit(i);
+        }
+        return hitMask;
+    }
 
     virtual bool bounds(double t0, double t1, AABB &bbox) const = 0;
 
@@ -45,13 +157,57 @@ public:
         return 0;
     }
 
-    virtual Vector3 random(const Vector3 &o) const
+    virtual Vector3 random(const Vector3 &o, Sampler& sampler) const
     {
         return {1, 0, 0};
     }
 
+    virtual double area() const
+    {
+        return 0;
+    }
+
+    // Total power emitted by the surface, its material looked up in the
+    // scene's table; zero for anything but a light.
+    virtual Vector3 power(const MaterialTable& materials) const
+    {
+        return {0, 0, 0};
+    }
+
+    // Append the emissive primitives at or below this node, as hitables
+    // that can be sampled for direct lighting in world space.
+    // Wrappers made for the purpose are allocated from the arena.
+    virtual void collectLights(std::vector<Hitable*>& lights, const MaterialTable& materials, Arena& arena)
+    {
+        const Vector3 p = power(materials);
+        if (p.x() > 0 || p.y() > 0 || p.z() > 0)
+            lights.push_back(this);
+    }
+
+    // Moves the keyframed nodes at or below this one to the animation frame
+    // and brings the bounds cached above them up to date.  Returns whether
+    // anything at or below is animated; the rest is left as built.
+    virtual bool setFrame(double frame)
+    {
+        return false;
+    }
 };
 
+inline void SurfaceHit::evaluate(const Ray& r, HitRecord& rec) const
+{
+    Ray local = r;
+    for (int i = numInstances - 1; i >= 0; i--)
+        local = instances[i]->rayToInstance(local);
+    rec.uvDensity = Vector2(0, 0);
+    primitive->surface(local, *this, rec);
+    for (int i = 0; i < numInstances; i++)
+        instances[i]->recordFromInstance(rec);
+    // Negation commutes with the instance transforms, so the flips along the
+    // way can be applied last.
+    if (flipNormal)
+        rec.normal = -rec.normal;
+}
+
 inline bool Quadradic(double a, double b, double c, double& t0, double& t1)
 {
     const double discriminant = b * b - 4.0 * a * c;
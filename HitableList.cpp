@@ -9,6 +9,33 @@
 
 #include "HitableList.h"
 #include "AABB.h"
+#include "Sampler.h"
+
+// intersect() for every ray of the packet at once, each with its own closest
+// hit so far.
+uint64_t HitableList::intersectPacket(const RayPacket& packet, uint64_t active, double tmin, const double* tmax,
+                                      SurfaceHit* hits) const
+{
+    double closestSoFar[RayPacket::MAX_RAYS];
+    for (uint64_t m = active; m != 0; m &= m - 1)
+    {
+        const int i = RayPacket::firstRay(m);
+        closestSoFar[i] = tmax[i];
+    }
+
+    uint64_t hitAnything = 0;
+    for (auto ip : list)
+    {
+        uint64_t hitMask = ip->intersectPacket(packet, active, tmin, closestSoFar, hits);
+        hitAnything |= hitMask;
+        for (; hitMask != 0; hitMask &= hitMask - 1)
+        {
+            const int i = RayPacket::firstRay(hitMask);
+            closestSoFar[i] = hits[i].t;
+        }
+    }
+    return hitAnything;
+}
 
 bool HitableList::bounds(double t0, double t1, AABB &bbox) const
 {
@@ -44,8 +71,29 @@ double HitableList::pdfValue(const Vector3& o, const Vector3& v) const
     return sum;
 }
 
-Vector3 HitableList::random(const Vector3& o) const
+double HitableList::area() const
+{
+    double sum = 0;
+    for (const auto ip : list)
+    {
+        sum += ip->area();
+    }
+    return sum;
+}
+
+Vector3 HitableList::power(const MaterialTable& materials) const
 {
-    auto index = size_t(drand48() * list.size());
-    return list.at(index)->random(o);
+    Vector3 sum(0, 0, 0);
+    for (const auto ip : list)
+    {
+        sum += ip->power(materials);
+    }
+    return sum;
+}
+
+Vector3 HitableList::random(const Vector3& o, Sampler& sampler) const
+{
+    auto index = size_t(sampler.get1D() * list.size());
+    return list.at(index)->random(o, sampler);
 }
+
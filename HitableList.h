@@ -21,28 +21,41 @@ public:
     explicit HitableList(std::vector<Hitable *> l) :
         list(std::move(l)) { }
 
-    bool hit(const Ray& r, double tmin, double tmax, HitRecord& rec) const override
+    bool intersect(const Ray& r, double tmin, double tmax, SurfaceHit& hit) const override
     {
-        HitRecord temp_rec;
         bool hit_anything = false;
         double closest_so_far = tmax;
         for (auto ip : list)
         {
-            if (ip->hit(r, tmin, closest_so_far, temp_rec))
+            if (ip->intersect(r, tmin, closest_so_far, hit))
             {
                 hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+                closest_so_far = hit.t;
             }
         }
         return hit_anything;
     }
 
+    uint64_t intersectPacket(const RayPacket& packet, uint64_t active, double tmin, const double* tmax,
+                             SurfaceHit* hits) const override;
+
     bool bounds(double t0, double t1, AABB& bbox) const override;
 
     double pdfValue(const Vector3& o, const Vector3& v) const override;
 
-    Vector3 random(const Vector3& o) const override;
+    Vector3 random(const Vector3& o, Sampler& sampler) const override;
+
+    double area() const override;
+
+    Vector3 power(const MaterialTable& materials) const override;
+
+    void collectLights(std::vector<Hitable*>& lights, const MaterialTable& materials, Arena& arena) override
+    {
+        for (auto ip : list)
+        {
+            ip->collectLights(lights, materials, arena);
+        }
+    }
 
     int numChildren() const override
     {
@@ -54,8 +67,24 @@ public:
         return numChildren;
     }
 
+    bool setFrame(double frame) override
+    {
+        if (!animated)
+            return false;
+        animated = false;
+        for (auto ip : list)
+        {
+            if (ip->setFrame(frame))
+                animated = true;
+        }
+        return animated;
+    }
+
     std::vector<Hitable*> list;
 
+    // Until a frame finds nothing animated in the list.
+    bool animated = true;
+
 };
 
 #endif //PATHTRACER_HITABLELIST_H
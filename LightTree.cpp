@@ -0,0 +1,231 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <algorithm>
+#include <cfloat>
+#include "LightTree.h"
+#include "Sampler.h"
+
+static const int MAX_DEPTH = 64;
+
+static Vector3 centroid(const AABB& box)
+{
+    return 0.5 * (box.min() + box.max());
+}
+
+LightTree::LightTree(const std::vector<Hitable*>& lights, const MaterialTable& materials) :
+    m_lights(lights)
+{
+    m_lightBounds.resize(m_lights.size());
+    m_lightPower.resize(m_lights.size());
+    for (size_t i = 0; i < m_lights.size(); i++)
+    {
+        m_lights[i]->bounds(0, 1, m_lightBounds[i]);
+
+        // Lights with no known power (e.g. sampling proxies without a
+        // material) are treated as equally bright.
+        m_lightPower[i] = luminance(m_lights[i]->power(materials));
+        if (m_lightPower[i] <= 0)
+            m_lightPower[i] = 1;
+    }
+
+    if (!m_lights.empty())
+    {
+        std::vector<int> indices(m_lights.size());
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = static_cast<int>(i);
+        m_nodes.reserve(2 * m_lights.size());
+        build(indices, 0, indices.size());
+    }
+}
+
+int LightTree::build(std::vector<int>& indices, size_t first, size_t last)
+{
+    const int index = static_cast<int>(m_nodes.size());
+    m_nodes.emplace_back();
+
+    if (last - first == 1)
+    {
+        Node& leaf = m_nodes[index];
+        leaf.light = indices[first];
+        leaf.bbox = m_lightBounds[leaf.light];
+        leaf.power = m_lightPower[leaf.light];
+        return index;
+    }
+
+    // Median split along the largest extent of the light centroids.
+    Vector3 cmin = centroid(m_lightBounds[indices[first]]);
+    Vector3 cmax = cmin;
+    for (size_t i = first + 1; i < last; i++)
+    {
+        const Vector3 c = centroid(m_lightBounds[indices[i]]);
+        for (int a = 0; a < 3; a++)
+        {
+            cmin[a] = std::min(cmin[a], c[a]);
+            cmax[a] = std::max(cmax[a], c[a]);
+        }
+    }
+    const Vector3 extent = cmax - cmin;
+    int axis = 0;
+    if (extent.y() > extent[axis]) axis = 1;
+    if (extent.z() > extent[axis]) axis = 2;
+
+    const size_t mid = (first + last) / 2;
+    std::nth_element(indices.begin() + first, indices.begin() + mid, indices.begin() + last,
+                     [this, axis](int a, int b)
+                     {
+                         return centroid(m_lightBounds[a])[axis] < centroid(m_lightBounds[b])[axis];
+                     });
+
+    const int left = build(indices, first, mid);
+    const int right = build(indices, mid, last);
+
+    Node& node = m_nodes[index];
+    node.left = left;
+    node.right = right;
+    node.bbox = AABB::join(m_nodes[left].bbox, m_nodes[right].bbox);
+    node.power = m_nodes[left].power + m_nodes[right].power;
+    return index;
+}
+
+double LightTree::importance(const Node& node, const Vector3& o) const
+{
+    // Clamp the distance to the size of the node so the importance stays
+    // finite, and roughly proportional to power, for points inside it.
+    const Vector3 diagonal = node.bbox.max() - node.bbox.min();
+    const double distSqrd = (centroid(node.bbox) - o).squared_length();
+    return node.power / std::max(distSqrd, 0.25 * diagonal.squared_length());
+}
+
+double LightTree::leftProbability(const Node& node, const Vector3& o) const
+{
+    const double left = importance(m_nodes[node.left], o);
+    const double right = importance(m_nodes[node.right], o);
+    if (left + right <= 0)
+        return 0.5;
+    return left / (left + right);
+}
+
+bool LightTree::intersect(const Ray& r, double tmin, double tmax, SurfaceHit& hit) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    bool hitAnything = false;
+    int stack[MAX_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Node& node = m_nodes[stack[--top]];
+        if (!node.bbox.hit(r, tmin, tmax))
+            continue;
+        if (node.light >= 0)
+        {
+            if (m_lights[node.light]->intersect(r, tmin, tmax, hit))
+            {
+                hitAnything = true;
+                tmax = hit.t;
+            }
+        }
+        else
+        {
+            stack[top++] = node.left;
+            stack[top++] = node.right;
+        }
+    }
+    return hitAnything;
+}
+
+bool LightTree::bounds(double t0, double t1, AABB& bbox) const
+{
+    if (m_nodes.empty())
+        return false;
+    bbox = m_nodes[0].bbox;
+    return true;
+}
+
+double LightTree::pdfValue(const Vector3& o, const Vector3& v) const
+{
+    if (m_nodes.empty())
+        return 0;
+
+    // Sum of selection probability times light pdf over every light the
+    // direction can reach; subtrees the ray misses contribute nothing.
+    const Ray ray(o, v);
+    struct Entry { int node; double probability; };
+    Entry stack[MAX_DEPTH];
+    int top = 0;
+    stack[top++] = {0, 1.0};
+
+    double pdf = 0;
+    while (top > 0)
+    {
+        const Entry entry = stack[--top];
+        const Node& node = m_nodes[entry.node];
+        if (!node.bbox.hit(ray, 0.001, DBL_MAX))
+            continue;
+        if (node.light >= 0)
+        {
+            pdf += entry.probability * m_lights[node.light]->pdfValue(o, v);
+        }
+        else
+        {
+            const double pl = leftProbability(node, o);
+            if (pl > 0)
+                stack[top++] = {node.left, entry.probability * pl};
+            if (pl < 1)
+                stack[top++] = {node.right, entry.probability * (1 - pl)};
+        }
+    }
+    return pdf;
+}
+
+Vector3 LightTree::random(const Vector3& o, Sampler& sampler) const
+{
+    if (m_nodes.empty())
+        return {1, 0, 0};
+
+    // A single uniform value is rescaled at each level to pick the branch.
+    double u = sampler.get1D();
+    int index = 0;
+    while (m_nodes[index].light < 0)
+    {
+        const Node& node = m_nodes[index];
+        const double pl = leftProbability(node, o);
+        if (u < pl)
+        {
+            u /= pl;
+            index = node.left;
+        }
+        else
+        {
+            u = (u - pl) / (1 - pl);
+            index = node.right;
+        }
+        u = std::min(u, 1 - DBL_EPSILON);
+    }
+    return m_lights[m_nodes[index].light]->random(o, sampler);
+}
+
+double LightTree::area() const
+{
+    double sum = 0;
+    for (const auto light : m_lights)
+        sum += light->area();
+    return sum;
+}
+
+Vector3 LightTree::power(const MaterialTable& materials) const
+{
+    Vector3 sum(0, 0, 0);
+    for (const auto light : m_lights)
+        sum += light->power(materials);
+    return sum;
+}
@@ -0,0 +1,72 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_LIGHTTREE_H
+#define PATHTRACER_LIGHTTREE_H
+
+#include <vector>
+#include "Hitable.h"
+#include "AABB.h"
+
+//
+// Bounding volume hierarchy over the emissive primitives of a scene.
+//
+// Lights are chosen by walking down the tree, picking a child in proportion
+// to its importance as seen from the shading point: the emitted power below
+// the node divided by the squared distance to its bounds.  Selection and pdf
+// evaluation are O(log n) in the number of lights, instead of the uniform
+// choice and O(n) pdf of a HitableList.
+//
+// Conty Estevez and Kulla, "Importance Sampling of Many Lights with Adaptive
+// Tree Splitting", 2018.
+//
+class LightTree : public Hitable
+{
+public:
+    LightTree(const std::vector<Hitable*>& lights, const MaterialTable& materials);
+
+    bool intersect(const Ray& r, double tmin, double tmax, SurfaceHit& hit) const override;
+
+    bool bounds(double t0, double t1, AABB& bbox) const override;
+
+    double pdfValue(const Vector3& o, const Vector3& v) const override;
+
+    Vector3 random(const Vector3& o, Sampler& sampler) const override;
+
+    double area() const override;
+
+    Vector3 power(const MaterialTable& materials) const override;
+
+    int numChildren() const override
+    { return static_cast<int>(m_nodes.size()); }
+
+private:
+    struct Node
+    {
+        AABB bbox;
+        double power = 0;
+        int left = -1;      // right child is always stored at 'right'
+        int right = -1;
+        int light = -1;     // index into m_lights for leaves, -1 otherwise
+    };
+
+    int build(std::vector<int>& indices, size_t first, size_t last);
+
+    double importance(const Node& node, const Vector3& o) const;
+
+    // Probability of descending into the left child of an interior node.
+    double leftProbability(const Node& node, const Vector3& o) const;
+
+    std::vector<Hitable*> m_lights;
+    std::vector<AABB> m_lightBounds;
+    std::vector<double> m_lightPower;
+    std::vector<Node> m_nodes;
+};
+
+#endif //PATHTRACER_LIGHTTREE_H
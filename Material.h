@@ -10,6 +10,9 @@
 #ifndef PATHTRACER_MATERIAL_H
 #define PATHTRACER_MATERIAL_H
 
+#include <cstdint>
+#include <variant>
+#include <vector>
 #include "Vector3.h"
 #include "Ray.h"
 #include "Hitable.h"
@@ -17,14 +20,24 @@
 #include "ONB.h"
 #include "PDF.h"
 
-class Pdf;
-
+//
+// The sampling pdf for a diffuse bounce is built in place inside the record
+// (pdf points at one of the inline members) so that scatter() never touches
+// the heap.  Consequently a ScatterRecord must not be copied once filled in.
+//
 struct ScatterRecord
 {
+    ScatterRecord() = default;
+    ScatterRecord(const ScatterRecord&) = delete;
+    ScatterRecord& operator=(const ScatterRecord&) = delete;
+
     Ray specularRay;
-    bool isSpecular;
-    Vector3 attenuation;
-    Pdf* pdf;
+    bool isSpecular{};
+    Vector3 attenuation{};
+    Pdf* pdf{};
+
+    CosinePdf cosinePdf;
+    ConstPdf constPdf;
 };
 
 inline double schlick(double cs, double ri)
@@ -34,35 +47,47 @@ inline double schlick(double cs, double ri)
     return r0 + (1-r0) * pow((1-cs), 5);
 }
 
-class Material
+//
+// The material types below are plain classes with non-virtual members; the
+// closed set of them is dispatched statically by Material, see the end of the
+// file.  MaterialBase supplies the defaults for a type that does not scatter
+// by a pdf or does not emit.
+//
+class MaterialBase
 {
 public:
-    virtual bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec) const = 0;
-    virtual double scatteringPdf(const Ray& r_in, const HitRecord& rec, const Ray& scattered) const
+    double scatteringPdf(const Ray& r_in, const HitRecord& rec, const Ray& scattered) const
     {
         return 0.0;
     }
-    virtual Vector3 emitted(const Ray& r_in, const HitRecord& rec, const Vector2& uv, const Vector3& p) const
+    Vector3 emitted(const Ray& r_in, const HitRecord& rec, const Vector2& uv, const Vector3& p) const
+    {
+        return {0, 0, 0};
+    }
+
+    // Representative emitted radiance, used to importance sample lights.
+    Vector3 emittedRadiance() const
     {
         return {0, 0, 0};
     }
 };
 
-class Lambertian : public Material
+class Lambertian : public MaterialBase
 {
 public:
     explicit Lambertian(Texture* a) :
             albedo(a) { }
 
-    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec) const override
+    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec, Sampler& sampler) const
     {
         srec.isSpecular = false;
-        srec.attenuation = albedo->value(rec.uv, rec.p);
-        srec.pdf = new CosinePdf(rec.normal);
+        srec.attenuation = albedo->value(rec.uv, rec.p, rec.footprint);
+        srec.cosinePdf = CosinePdf(rec.normal);
+        srec.pdf = &srec.cosinePdf;
         return true;
     }
 
-    double scatteringPdf(const Ray& r_in, const HitRecord& rec, const Ray& scattered) const override
+    double scatteringPdf(const Ray& r_in, const HitRecord& rec, const Ray& scattered) const
     {
         double cosine = dot(rec.normal, unit_vector(scattered.direction()));
         if (cosine < 0) return 0;
@@ -70,10 +95,12 @@ public:
     }
 
 private:
+    friend class ScenePackageWriter;
+
     Texture* albedo;
 };
 
-class Metal : public Material
+class Metal : public MaterialBase
 {
 public:
     Metal(const Vector3& a, double f) :
@@ -83,10 +110,10 @@ public:
         if (f < 1) { fuzz = f; }
     }
 
-    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec) const override
+    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec, Sampler& sampler) const
     {
         Vector3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-        srec.specularRay = Ray(rec.p, reflected + fuzz * randomInUnitSphere());
+        srec.specularRay = Ray(rec.p, reflected + fuzz * randomInUnitSphere(sampler));
         srec.attenuation = albedo;
         srec.isSpecular = true;
         srec.pdf = nullptr;
@@ -94,17 +121,19 @@ public:
     }
 
 private:
+    friend class ScenePackageWriter;
+
     Vector3 albedo;
     double fuzz;
 };
 
-class Dielectric : public Material
+class Dielectric : public MaterialBase
 {
 public:
     explicit Dielectric(double ri) :
         refIndex(ri) { }
 
-    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec) const override
+    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec, Sampler& sampler) const
     {
         srec.isSpecular = true;
         srec.pdf = nullptr;
@@ -134,7 +163,7 @@ public:
         {
             reflectProb = 1.0;
         }
-        if (drand48() < reflectProb)
+        if (sampler.get1D() < reflectProb)
         {
             srec.specularRay = Ray(rec.p, reflected);
         }
@@ -146,54 +175,146 @@ public:
     }
 
 private:
+    friend class ScenePackageWriter;
+
     double refIndex;
 };
 
-class DiffuseLight : public Material
+class DiffuseLight : public MaterialBase
 {
 public:
     explicit DiffuseLight(Texture* a) :
         emit(a) {}
 
-    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec) const override
+    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec, Sampler& sampler) const
     {
         return false;
     }
 
-    Vector3 emitted(const Ray& r_in, const HitRecord& rec, const Vector2& uv, const Vector3& p) const override
+    Vector3 emitted(const Ray& r_in, const HitRecord& rec, const Vector2& uv, const Vector3& p) const
     {
         if (dot(rec.normal, r_in.direction()) < 0)
-            return emit->value(uv, p);
+            return emit->value(uv, p, rec.footprint);
 
         return {0, 0, 0};
     }
 
+    // Exact for constant textures, a single lookup for anything else.
+    Vector3 emittedRadiance() const
+    {
+        return emit->value(Vector2(0.5, 0.5), Vector3(0, 0, 0), Vector2(0, 0));
+    }
+
 private:
+    friend class ScenePackageWriter;
+
     Texture* emit;
 };
 
-class Isotropic : public Material
+class Isotropic : public MaterialBase
 {
 public:
     explicit Isotropic(Texture* a) :
         albedo(a) {}
 
-    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec) const override
+    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec, Sampler& sampler) const
     {
-        // TODO: fix this for new ScatterRecord
         srec.isSpecular = false;
-        srec.attenuation = albedo->value(rec.uv, rec.p);
-        srec.pdf = new ConstPdf();
+        srec.attenuation = albedo->value(rec.uv, rec.p, rec.footprint);
+        srec.pdf = &srec.constPdf;
         return true;
     }
 
-    double scatteringPdf(const Ray& r_in, const HitRecord& rec, const Ray& scattered) const override
+    double scatteringPdf(const Ray& r_in, const HitRecord& rec, const Ray& scattered) const
     {
         return 1.0 / (4 * M_PI);
     }
 
 private:
+    friend class ScenePackageWriter;
+
     Texture* albedo;
 };
 
+//
+// Any one of the material types.  Shading calls switch on the type and call
+// the member directly, so there is no indirect branch and the member can be
+// inlined, which a virtual call prevents.  The switch is written out rather
+// than left to std::visit, which may dispatch through a table of function
+// pointers.
+//
+class Material
+{
+public:
+    template <typename T>
+    Material(const T& material) :
+        m_material(material) { }
+
+    bool scatter(const Ray& r_in, const HitRecord& rec, ScatterRecord& srec, Sampler& sampler) const
+    {
+        return dispatch<bool>([&](const auto& m) { return m.scatter(r_in, rec, srec, sampler); });
+    }
+    double scatteringPdf(const Ray& r_in, const HitRecord& rec, const Ray& scattered) const
+    {
+        return dispatch<double>([&](const auto& m) { return m.scatteringPdf(r_in, rec, scattered); });
+    }
+    Vector3 emitted(const Ray& r_in, const HitRecord& rec, const Vector2& uv, const Vector3& p) const
+    {
+        return dispatch<Vector3>([&](const auto& m) { return m.emitted(r_in, rec, uv, p); });
+    }
+    Vector3 emittedRadiance() const
+    {
+        return dispatch<Vector3>([&](const auto& m) { return m.emittedRadiance(); });
+    }
+
+    // Index of the material's type, in the order of the variant below.
+    size_t type() const { return m_material.index(); }
+
+private:
+    friend class ScenePackageWriter;
+
+    template <typename R, typename F>
+    R dispatch(F&& f) const
+    {
+        switch (m_material.index())
+        {
+        case 0: return f(*std::get_if<0>(&m_material));
+        case 1: return f(*std::get_if<1>(&m_material));
+        case 2: return f(*std::get_if<2>(&m_material));
+        case 3: return f(*std::get_if<3>(&m_material));
+        default: return f(*std::get_if<4>(&m_material));
+        }
+    }
+
+    std::variant<Lambertian, Metal, Dielectric, DiffuseLight, Isotropic> m_material;
+};
+
+//
+// Every material of a scene, see Scene.h, stored contiguously and referenced
+// by index from the primitives and hit records.  Materials are only added while the
+// scene is built, never while it is rendered.
+//
+class MaterialTable
+{
+public:
+    MaterialId add(const Material& material)
+    {
+        m_materials.push_back(material);
+        return MaterialId(m_materials.size() - 1);
+    }
+
+    const Material& operator[](MaterialId id) const { return m_materials[id]; }
+
+    size_t size() const { return m_materials.size(); }
+
+private:
+    std::vector<Material> m_materials;
+};
+
+// Power emitted by a diffuse surface with the given material and area.
+inline Vector3 surfacePower(const MaterialTable& materials, MaterialId material, double area)
+{
+    return (M_PI * area) * materials[material].emittedRadiance();
+}
+
 #endif //PATHTRACER_MATERIAL_H
@@ -9,29 +9,63 @@
 
 #include <cfloat>
 #include "Medium.h"
+#include "AABB.h"
+#include "Random.h"
 
-bool ConstantMedium::hit(const Ray &r_in, double t0, double t1, HitRecord &rec) const
+//
+// The free-flight distance is drawn from the ray's medium sample, a sampler
+// dimension of its bounce, so hit() stays thread safe and gives the same answer
+// no matter which thread traces the ray.  Each medium hashes the sample with a
+// key of its own, from its boundary and density, so the distances in media the
+// same ray crosses are independent, as closest-hit traversal needs them to be
+// for the nearest scattering to be distributed correctly.
+//
+uint64_t ConstantMedium::key(const Hitable* boundary, double density)
 {
-    HitRecord rec1, rec2;
-    if (boundary->hit(r_in, -DBL_MAX, DBL_MAX, rec1))
+    uint64_t h = hashDouble(density, 0);
+    AABB bbox;
+    if (boundary->bounds(0, 1, bbox))
     {
-        if (boundary->hit(r_in, rec1.t+0.0001, DBL_MAX, rec2))
+        for (int i = 0; i < 3; i++)
         {
-            if (rec1.t < t0) rec1.t = t0;
-            if (rec2.t > t1) rec2.t = t1;
-            if (rec1.t > rec2.t) return false;
-            if (rec1.t < 0) rec1.t = 0;
-            double distInsideBoundary = (rec2.t - rec1.t) * r_in.direction().length();
-            double hitDist = -(1/density)*log(drand48());
+            h = hashDouble(bbox.min()[i], h);
+            h = hashDouble(bbox.max()[i], h);
+        }
+    }
+    return h;
+}
+
+bool ConstantMedium::intersect(const Ray &r_in, double t0, double t1, SurfaceHit &hit) const
+{
+    SurfaceHit hit1, hit2;
+    if (boundary->intersect(r_in, -DBL_MAX, DBL_MAX, hit1))
+    {
+        if (boundary->intersect(r_in, hit1.t+0.0001, DBL_MAX, hit2))
+        {
+            if (hit1.t < t0) hit1.t = t0;
+            if (hit2.t > t1) hit2.t = t1;
+            if (hit1.t > hit2.t) return false;
+            if (hit1.t < 0) hit1.t = 0;
+            double distInsideBoundary = (hit2.t - hit1.t) * r_in.direction().length();
+            // Mapped to (0, 1] so the log is always finite.
+            const uint64_t h = hashDouble(r_in.mediumSample(), streamKey);
+            const double u = ((h >> 11u) + 1) * (1.0 / 9007199254740992.0);
+            double hitDist = -(1/density)*log(u);
             if (hitDist < distInsideBoundary)
             {
-                rec.t = rec1.t + hitDist / r_in.direction().length();
-                rec.p = r_in.pointAt(rec.t);
-                rec.normal = Vector3(1, 0, 0);
-                rec.material = phaseFunction;
+                hit.set(this, hit1.t + hitDist / r_in.direction().length());
                 return true;
             }
         }
     }
     return false;
 }
+
+void ConstantMedium::surface(const Ray &r_in, const SurfaceHit &hit, HitRecord &rec) const
+{
+    rec.t = hit.t;
+    rec.p = r_in.pointAt(rec.t);
+    rec.normal = Vector3(1, 0, 0);
+    rec.material = phaseFunction;
+}
+
@@ -11,20 +11,19 @@
 #define PATHTRACER_MEDIUM_H
 
 #include "Hitable.h"
-#include "Texture.h"
-#include "Material.h"
 
 class ConstantMedium : public Hitable
 {
 public:
-    ConstantMedium(Hitable* b, double d, Texture* a) :
+    ConstantMedium(Hitable* b, double d, MaterialId phase) :
         boundary(b),
-        density(d)
-    {
-        phaseFunction = new Isotropic(a);
-    }
+        density(d),
+        phaseFunction(phase),
+        streamKey(key(b, d)) { }
+
+    bool intersect(const Ray& r_in, double t0, double t1, SurfaceHit& hit) const override;
 
-    bool hit(const Ray& r_in, double t0, double t1, HitRecord& rec) const override;
+    void surface(const Ray& r_in, const SurfaceHit& hit, HitRecord& rec) const override;
 
     bool bounds(double t0, double t1, AABB& bbox) const override
     {
@@ -34,9 +33,18 @@ public:
     int numChildren() const override
     { return 1 + boundary->numChildren(); }
 
+    bool setFrame(double frame) override
+    { return boundary->setFrame(frame); }
+
     Hitable* boundary;
     double density;
-    Material* phaseFunction;
+    MaterialId phaseFunction;
+
+private:
+    static uint64_t key(const Hitable* boundary, double density);
+
+    // Decorrelates the free flights of the media a ray crosses.
+    uint64_t streamKey;
 };
 
 
@@ -0,0 +1,83 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <cstdint>
+#include "Numa.h"
+#ifdef PATHTRACER_HAVE_NUMA
+#include <numa.h>
+#include <unistd.h>
+#endif
+
+bool Numa::available()
+{
+#ifdef PATHTRACER_HAVE_NUMA
+    static const bool supported = (numa_available() >= 0);
+    return supported;
+#else
+    return false;
+#endif
+}
+
+int Numa::numNodes()
+{
+#ifdef PATHTRACER_HAVE_NUMA
+    if (available())
+        return numa_num_configured_nodes();
+#endif
+    return 1;
+}
+
+int Numa::threadNode(int thread, int numThreads)
+{
+    return int((long long)thread * numNodes() / numThreads);
+}
+
+void Numa::bindThread(int node)
+{
+#ifdef PATHTRACER_HAVE_NUMA
+    if (!available())
+        return;
+    numa_run_on_node(node);
+    numa_set_preferred(node);
+#else
+    (void)node;
+#endif
+}
+
+void Numa::placeOnNode(void* data, size_t size, int node)
+{
+#ifdef PATHTRACER_HAVE_NUMA
+    if (!available() || size == 0)
+        return;
+    // The policy applies to whole pages; the pages at either end of the
+    // range may be shared with the neighbouring ranges.
+    const auto pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = uintptr_t(data) & ~(pageSize - 1);
+    const uintptr_t end = uintptr_t(data) + size;
+    numa_tonode_memory(reinterpret_cast<void*>(begin), end - begin, node);
+#else
+    (void)data;
+    (void)size;
+    (void)node;
+#endif
+}
+
+void Numa::interleaveAllocations(bool interleave)
+{
+#ifdef PATHTRACER_HAVE_NUMA
+    if (!available())
+        return;
+    if (interleave)
+        numa_set_interleave_mask(numa_all_nodes_ptr);
+    else
+        numa_set_localalloc();
+#else
+    (void)interleave;
+#endif
+}
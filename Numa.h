@@ -0,0 +1,42 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_NUMA_H
+#define PATHTRACER_NUMA_H
+
+#include <cstddef>
+
+//
+// Memory and thread placement on multi-socket machines, through libnuma when
+// the build found it.  Without it, or on a single node machine, there is one
+// node and every call is a no-op.
+//
+namespace Numa
+{
+    bool available();
+
+    int numNodes();
+
+    // Node of the i'th of n threads, threads split into equal contiguous
+    // blocks per node.
+    int threadNode(int thread, int numThreads);
+
+    // Run the calling thread on the CPUs of 'node' and allocate its memory
+    // there.
+    void bindThread(int node);
+
+    // Pages of [data, data + size) are placed on 'node' when first touched.
+    void placeOnNode(void* data, size_t size, int node);
+
+    // Spread the calling thread's allocations over every node, or return to
+    // allocating on the local node.
+    void interleaveAllocations(bool interleave);
+}
+
+#endif //PATHTRACER_NUMA_H
@@ -13,43 +13,75 @@
 
 #include "Vector3.h"
 #include "ONB.h"
+#include "Sampler.h"
 
-inline Vector3 randomInUnitSphere()
+//
+// The sample warps below map a fixed number of sampler dimensions onto their
+// domain (no rejection loops) so that stratified samplers keep their
+// distribution properties.
+//
+
+// Uniform direction on the unit sphere; consumes 2 dimensions.
+inline Vector3 randomOnUnitSphere(Sampler& sampler)
 {
-    Vector3 p{};
-    do
-    {
-        p = 2.0*Vector3(drand48(), drand48(), drand48())-Vector3(1, 1, 1);
-    }
-    while (p.squared_length()>=1.0);
-    return p;
+    Vector2 u = sampler.get2D();
+    double z = 1 - 2 * u.x();
+    double r = sqrt(std::max(0.0, 1 - z * z));
+    double phi = 2 * M_PI * u.y();
+    return {r * cos(phi), r * sin(phi), z};
+}
+
+// Uniform point in the unit ball; consumes 3 dimensions.
+inline Vector3 randomInUnitSphere(Sampler& sampler)
+{
+    Vector3 dir = randomOnUnitSphere(sampler);
+    return cbrt(sampler.get1D()) * dir;
 }
 
-inline Vector3 randomInUnitDisk()
+// Uniform point in the unit disk using the concentric mapping; consumes 2 dimensions.
+//
+// Peter Shirley and Kenneth Chiu, "A Low Distortion Map Between Disk and Square",
+// Journal of Graphics Tools, Vol. 2, No. 3, 1997.
+//
+inline Vector3 randomInUnitDisk(Sampler& sampler)
 {
-    Vector3 p{};
-    do
+    Vector2 u = sampler.get2D();
+    double a = 2 * u.x() - 1;
+    double b = 2 * u.y() - 1;
+    if (a == 0 && b == 0)
+        return {0, 0, 0};
+
+    double r, phi;
+    if (a * a > b * b)
+    {
+        r = a;
+        phi = (M_PI / 4) * (b / a);
+    }
+    else
     {
-        p = 2 * Vector3(drand48(), drand48(), 0) - Vector3(1, 1, 0);
-    } while (dot(p, p) >= 1.0);
-    return p;
+        r = b;
+        phi = (M_PI / 2) - (M_PI / 4) * (a / b);
+    }
+    return {r * cos(phi), r * sin(phi), 0};
 }
 
-inline Vector3 randomCosineDirection()
+inline Vector3 randomCosineDirection(Sampler& sampler)
 {
-    double r1 = drand48();
-    double r2 = drand48();
+    Vector2 u = sampler.get2D();
+    double r1 = u.x();
+    double r2 = u.y();
     double z = sqrt(1 - r2);
     double phi = 2 * M_PI * r1;
-    double x = cos(phi) * 2 * sqrt(r2);
-    double y = sin(phi) * 2 * sqrt(r2);
+    double x = cos(phi) * sqrt(r2);
+    double y = sin(phi) * sqrt(r2);
     return {x, y, z};
 }
 
-inline Vector3 randomToUnitSphere(double radius, double distSqrd)
+inline Vector3 randomToUnitSphere(double radius, double distSqrd, Sampler& sampler)
 {
-    double r1 = drand48();
-    double r2 = drand48();
+    Vector2 u = sampler.get2D();
+    double r1 = u.x();
+    double r2 = u.y();
     double z = 1 + r2 * (sqrt(1 - radius*radius/distSqrd) - 1);
     double phi = 2 * M_PI * r1;
     double x = cos(phi)*sqrt(1-z*z);
@@ -63,22 +95,25 @@ public:
     virtual ~Pdf() = default;
 
     virtual double value(const Vector3& direction) const = 0;
-    virtual Vector3 generate() const = 0;
+    virtual Vector3 generate(Sampler& sampler) const = 0;
 };
 
+// Uniform over the sphere of directions.
 class ConstPdf : public Pdf
 {
 public:
     double value(const Vector3& direction) const override
-    { return 1; };
+    { return 1 / (4 * M_PI); };
 
-    Vector3 generate() const override
-    { return randomToUnitSphere(1, 1); };
+    Vector3 generate(Sampler& sampler) const override
+    { return randomOnUnitSphere(sampler); };
 };
 
 class CosinePdf : public Pdf
 {
 public:
+    CosinePdf() = default;
+
     explicit CosinePdf(const Vector3& w) { uvw.buildFromW(w); }
 
     double value(const Vector3& direction) const override
@@ -90,9 +125,9 @@ public:
         return 0;
     }
 
-    Vector3 generate() const override
+    Vector3 generate(Sampler& sampler) const override
     {
-        return uvw.local(randomCosineDirection());
+        return uvw.local(randomCosineDirection(sampler));
     }
 
 private:
@@ -111,9 +146,9 @@ public:
         return hitable->pdfValue(origin, direction);
     }
 
-    Vector3 generate() const override
+    Vector3 generate(Sampler& sampler) const override
     {
-        return hitable->random(origin);
+        return hitable->random(origin, sampler);
     }
 
 private:
@@ -131,15 +166,32 @@ public:
         return 0.5 * p[0]->value(direction) + 0.5 * p[1]->value(direction);
     }
 
-    Vector3 generate() const override
+    Vector3 generate(Sampler& sampler) const override
     {
-        if (drand48() < 0.5)
-            return p[0]->generate();
+        if (sampler.get1D() < 0.5)
+            return p[0]->generate(sampler);
 
-        return p[1]->generate();
+        return p[1]->generate(sampler);
     }
 
 private:
     Pdf* p[2] = {nullptr, nullptr};
 };
+
+// Multiple importance sampling weight for a sample drawn from the strategy
+// with density pdfA, combined with one sample from the strategy with pdfB.
+//
+// Eric Veach and Leonidas Guibas, "Optimally Combining Sampling Techniques for
+// Monte Carlo Rendering", SIGGRAPH 1995.
+//
+inline double misWeight(double pdfA, double pdfB, bool powerHeuristic)
+{
+    if (powerHeuristic)
+    {
+        pdfA *= pdfA;
+        pdfB *= pdfB;
+    }
+    return pdfA / (pdfA + pdfB);
+}
+
 #endif //PATHTRACER_PDF_H
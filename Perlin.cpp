@@ -8,6 +8,10 @@
  */
 
 #include "Perlin.h"
+#include "Random.h"
+
+// Fixed seed so the noise tables are identical on every run and machine.
+static Random g_perlinRandom(0x5eed);
 
 Vector3* Perlin::ranvec = Perlin::generate();
 double* Perlin::ranfloat = Perlin::generate_double();
@@ -39,7 +43,7 @@ void permute(int* p, int n)
 {
     for (int i = n-1; i > 0; i--)
     {
-        auto target = int(drand48()*(i+1));
+        auto target = int(g_perlinRandom.nextDouble()*(i+1));
         int tmp = p[i];
         p[i] = p[target];
         p[target] = tmp;
@@ -59,7 +63,7 @@ Vector3* Perlin::generate()
     auto * p = new Vector3[256];
     for (int i = 0; i < 256; i++)
     {
-        p[i] = unit_vector(Vector3(-1+2*drand48(), -1 + 2 * drand48(), -1 + 2 * drand48()));
+        p[i] = unit_vector(Vector3(-1+2*g_perlinRandom.nextDouble(), -1 + 2 * g_perlinRandom.nextDouble(), -1 + 2 * g_perlinRandom.nextDouble()));
     }
     return p;
 }
@@ -68,7 +72,7 @@ double* Perlin::generate_double()
 {
     auto *p = new double[256];
     for (int i = 0; i < 256; i++)
-        p[i] = drand48();
+        p[i] = g_perlinRandom.nextDouble();
     return p;
 }
 
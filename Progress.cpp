@@ -14,21 +14,29 @@
 #include <unistd.h>
 #include "Progress.h"
 
+static const std::chrono::milliseconds REDRAW_INTERVAL(100);
+
 int GetTerminalWidth()
 {
-    struct winsize w;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+    struct winsize w{};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != 0 || w.ws_col == 0)
+        return 80;
     return w.ws_col;
 }
 
 Progress::Progress(int totalIterations, const std::string &title, const std::string& statusLabel) :
     m_totalIterations(totalIterations),
     m_iterationsCompleted(0),
+    m_value(0.0f),
     m_printed(0),
     m_total(0),
+    m_linesPrinted(0),
     m_buf(nullptr),
     m_curSpace(nullptr),
-    m_statusLabel(statusLabel)
+    m_title(title),
+    m_statusLabel(statusLabel),
+    m_terminal(isatty(STDOUT_FILENO) != 0),
+    m_stop(false)
 {
     int length = GetTerminalWidth() - 42;
     m_total = std::max(2, length - static_cast<int>(title.size()) - static_cast<int>(m_statusLabel.size()));
@@ -43,33 +51,48 @@ Progress::Progress(int totalIterations, const std::string &title, const std::str
     *s++ = ']';
     *s++ = ' ';
     *s++ = '\0';
-    fputs(m_buf, stdout);
-    fflush(stdout);
-    system("tput civis");
+    if (m_terminal)
+    {
+        fputs(m_buf, stdout);
+        fflush(stdout);
+        system("tput civis");
+    }
     m_start = std::chrono::steady_clock::now();
+    m_reporter = std::thread(&Progress::reporterMain, this);
 }
 
 Progress::~Progress()
 {
+    stopReporter();
     delete[] m_buf;
 }
 
-void Progress::update(int numIterations, float value)
+void Progress::reporterMain()
 {
-    m_iterationsCompleted += numIterations;
-    float percentDone = static_cast<float>(m_iterationsCompleted) / static_cast<float>(m_totalIterations);
-    auto needed = static_cast<int>(roundf(m_total * percentDone));
-    if (needed > m_total) needed = m_total;
-    while (m_printed < needed)
+    std::unique_lock<std::mutex> lock(m_stopMutex);
+    while (!m_stopSignal.wait_for(lock, REDRAW_INTERVAL, [this]() { return m_stop; }))
+        draw();
+}
+
+void Progress::stopReporter()
+{
+    if (!m_reporter.joinable())
+        return;
     {
-        *m_curSpace++ = '*';
-        ++m_printed;
+        std::lock_guard<std::mutex> lock(m_stopMutex);
+        m_stop = true;
     }
-    fputs(m_buf, stdout);
+    m_stopSignal.notify_one();
+    m_reporter.join();
+}
+
+void Progress::draw()
+{
+    float percentDone = static_cast<float>(m_iterationsCompleted.load(std::memory_order_relaxed)) / static_cast<float>(m_totalIterations);
     auto now = std::chrono::steady_clock::now();
     auto elapsed = now - m_start;
     float totalSeconds = static_cast<float>(std::chrono::duration_cast<std::chrono::seconds>(elapsed).count());
-    float estRemaining = totalSeconds / percentDone - totalSeconds;
+    float estRemaining = (percentDone > 0.0f) ? totalSeconds / percentDone - totalSeconds : 0.0f;
     auto hours = static_cast<int>(floorf(totalSeconds/3600.0f));
     totalSeconds -= hours * 3600;
     auto minutes = static_cast<int>(floorf(totalSeconds/60.0f));
@@ -79,6 +102,28 @@ void Progress::update(int numIterations, float value)
     auto estMinutes = static_cast<int>(floorf(estRemaining/60.0f));
     int estSeconds = static_cast<int>(estRemaining) % 60;
 
+    if (!m_terminal)
+    {
+        // A line per 10% rather than a bar redrawn over itself in a log.
+        auto step = std::min(10, static_cast<int>(floorf(10.0f * percentDone)));
+        if (step <= m_linesPrinted || step >= 10)
+            return;
+        m_linesPrinted = step;
+        fprintf(stdout, "%s: %3d%% (%3d:%02d:%02ds|%3d:%02d:%02ds)\n", m_title.c_str(), 10 * step,
+                hours, minutes, seconds, estHours, estMinutes, std::max(0, estSeconds));
+        fflush(stdout);
+        return;
+    }
+
+    auto needed = static_cast<int>(roundf(m_total * percentDone));
+    if (needed > m_total) needed = m_total;
+    while (m_printed < needed)
+    {
+        *m_curSpace++ = '*';
+        ++m_printed;
+    }
+    fputs(m_buf, stdout);
+
     if (percentDone >= 1.0f)
     {
         fprintf(stdout, " (%3d:%02d:%02ds)           ", hours, minutes, seconds);
@@ -88,18 +133,15 @@ void Progress::update(int numIterations, float value)
         if (m_statusLabel.empty())
             fprintf(stdout, " (%3d:%02d:%02ds|%3d:%02d:%02ds)  ", hours, minutes, seconds, estHours, estMinutes, std::max(0, estSeconds));
         else
-            fprintf(stdout, " (%3d:%02d:%02ds|%3d:%02d:%02ds) %s=%6.2f", hours, minutes, seconds, estHours, estMinutes, std::max(0, estSeconds), m_statusLabel.c_str(), value);
+            fprintf(stdout, " (%3d:%02d:%02ds|%3d:%02d:%02ds) %s=%6.2f", hours, minutes, seconds, estHours, estMinutes, std::max(0, estSeconds), m_statusLabel.c_str(), m_value.load(std::memory_order_relaxed));
     }
     fflush(stdout);
 }
 
 void Progress::completed()
 {
-    while (m_printed++ < m_total)
-    {
-        *m_curSpace++ = '+';
-    }
-    fputs(m_buf, stdout);
+    stopReporter();
+
     auto now = std::chrono::steady_clock::now();
     auto elapsed = now - m_start;
     float totalSeconds = static_cast<float>(std::chrono::duration_cast<std::chrono::seconds>(elapsed).count());
@@ -107,6 +149,18 @@ void Progress::completed()
     totalSeconds -= hours * 3600;
     auto minutes = static_cast<int>(floorf(totalSeconds/60.0f));
     int seconds = static_cast<int>(totalSeconds) % 60;
+    if (!m_terminal)
+    {
+        fprintf(stdout, "%s: 100%% (%3d:%02d:%02ds)\n", m_title.c_str(), hours, minutes, seconds);
+        fflush(stdout);
+        return;
+    }
+
+    while (m_printed++ < m_total)
+    {
+        *m_curSpace++ = '+';
+    }
+    fputs(m_buf, stdout);
     fprintf(stdout, " (%3d:%02d:%02ds)           \n", hours, minutes, seconds);
     fflush(stdout);
     system("tput cnorm");
@@ -12,6 +12,17 @@
 
 #include <string>
 #include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//
+// Progress bar drawn by a reporter thread of its own at a fixed rate.  The
+// render threads only add to an atomic counter, so they never wait on each
+// other or on the terminal.  When stdout is not a terminal a plain line is
+// written every 10% instead.
+//
 class Progress
 {
 public:
@@ -19,17 +30,35 @@ public:
 
     ~Progress();
 
-    void update(int numIterations = 1, float value = 0.0f);
+    // Safe to call from any thread.
+    void update(int numIterations = 1, float value = 0.0f)
+    {
+        m_iterationsCompleted.fetch_add(numIterations, std::memory_order_relaxed);
+        m_value.store(value, std::memory_order_relaxed);
+    }
 
     void completed();
 
 protected:
+    void reporterMain();
+    void draw();
+    void stopReporter();
+
     int m_totalIterations;
-    int m_iterationsCompleted;
+    std::atomic<int> m_iterationsCompleted;
+    std::atomic<float> m_value;
     int m_printed, m_total;
+    int m_linesPrinted;
     char *m_buf, *m_curSpace;
+    const std::string m_title;
     const std::string m_statusLabel;
+    const bool m_terminal;
     std::chrono::steady_clock::time_point m_start;
+
+    std::thread m_reporter;
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopSignal;
+    bool m_stop;
 };
 
 #endif //PATHTRACER_PROGRESS_H
@@ -0,0 +1,119 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_RANDOM_H
+#define PATHTRACER_RANDOM_H
+
+#include <cstdint>
+#include <cstring>
+
+//
+// PCG32 random number generator.
+//
+// Melissa O'Neill, "PCG: A Family of Simple Fast Space-Efficient Statistically
+// Good Algorithms for Random Number Generation", 2014.
+// http://www.pcg-random.org
+//
+// Each generator is small enough to live on the stack; the renderer creates
+// one per pixel, selecting the PCG stream from the pixel index, so the image
+// does not depend on how pixels are distributed across threads.
+//
+class Random
+{
+public:
+    Random()
+    {
+        setSequence(0, 0);
+    }
+
+    explicit Random(uint64_t stream, uint64_t seed = 0)
+    {
+        setSequence(stream, seed);
+    }
+
+    void setSequence(uint64_t stream, uint64_t seed)
+    {
+        m_state = 0;
+        m_inc = (stream << 1u) | 1u;
+        nextUInt();
+        m_state += seed + 0x853c49e6748fea9bULL;
+        nextUInt();
+    }
+
+    uint32_t nextUInt()
+    {
+        uint64_t oldState = m_state;
+        m_state = oldState * 6364136223846793005ULL + m_inc;
+        auto xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+        auto rot = static_cast<uint32_t>(oldState >> 59u);
+        return (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31u));
+    }
+
+    // Uniform double in [0, 1).
+    double nextDouble()
+    {
+        return nextUInt() * (1.0 / 4294967296.0);
+    }
+
+    // Skip the next 'delta' numbers in O(log delta).
+    //
+    // Forrest Brown, "Random Number Generation with Arbitrary Stride",
+    // Trans. Am. Nucl. Soc., 1994.
+    void advance(uint64_t delta)
+    {
+        uint64_t mult = 6364136223846793005ULL, plus = m_inc;
+        uint64_t accMult = 1, accPlus = 0;
+        while (delta > 0)
+        {
+            if (delta & 1u)
+            {
+                accMult *= mult;
+                accPlus = accPlus * mult + plus;
+            }
+            plus = (mult + 1) * plus;
+            mult *= mult;
+            delta >>= 1u;
+        }
+        m_state = accMult * m_state + accPlus;
+    }
+
+    // Counter-based construction: the sequence is a pure function of
+    // (seed, pixel, sample), so a sample sees the same random numbers no
+    // matter when, where or in what order it is rendered.
+    static Random forSample(uint64_t seed, uint64_t pixel, uint64_t sample);
+
+private:
+    uint64_t m_state{};
+    uint64_t m_inc{};
+};
+
+// SplitMix64 finalizer - a cheap, well distributed 64-bit hash.
+inline uint64_t mixBits(uint64_t v)
+{
+    v ^= v >> 31u;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27u;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33u;
+    return v;
+}
+
+inline uint64_t hashDouble(double d, uint64_t h)
+{
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return mixBits(h ^ (bits + 0x9e3779b97f4a7c15ULL + (h << 6u) + (h >> 2u)));
+}
+
+inline Random Random::forSample(uint64_t seed, uint64_t pixel, uint64_t sample)
+{
+    return Random(mixBits(pixel ^ mixBits(seed)), mixBits(sample + 0x9e3779b97f4a7c15ULL * (pixel + 1)));
+}
+
+#endif //PATHTRACER_RANDOM_H
@@ -31,12 +31,19 @@ public:
 
     double time() const { return m_time; }
 
+    // Uniform in [0, 1) from the sampler that places the ray's scattering
+    // in any participating medium it crosses, see ConstantMedium.
+    double mediumSample() const { return m_mediumSample; }
+
+    void setMediumSample(double u) { m_mediumSample = u; }
+
     Vector3 pointAt(double t) const { return m_origin + t * m_dir; }
 
 protected:
     Vector3 m_origin;
     Vector3 m_dir;
     double m_time;
+    double m_mediumSample = 0.5;
 };
 
 #endif //PATHTRACER_RAY_H
@@ -0,0 +1,85 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_RAYPACKET_H
+#define PATHTRACER_RAYPACKET_H
+
+#include <cmath>
+#include <cstdint>
+#include "Ray.h"
+
+//
+// Up to 64 rays traced through the scene together, typically camera rays
+// through a block of neighbouring pixels.  Subsets of the packet are passed
+// around as bit masks.
+//
+// When the packet is coherent, meaning every ray's direction has the same sign
+// on each axis, it also carries interval bounds of the ray origins and
+// reciprocal directions.  With interval arithmetic a bounding box can then be
+// rejected for the whole packet with a single test, see AABB::overlap.
+//
+// Solomon Boulos et al., "Geometric and Arithmetic Culling Methods for Entire
+// Ray Packets", University of Utah Tech. Report UUCS-06-010, 2006.
+//
+struct RayPacket
+{
+    static const int MAX_RAYS = 64;
+
+    static uint64_t bit(int i) { return uint64_t(1) << unsigned(i); }
+
+    // Index of the lowest ray in a non-empty mask.  Masks are walked with
+    //   for (uint64_t m = mask; m != 0; m &= m - 1) { int i = firstRay(m); ... }
+    static int firstRay(uint64_t mask)
+    {
+#if defined(__GNUC__)
+        return __builtin_ctzll(mask);
+#else
+        int i = 0;
+        for (; !(mask & 1u); mask >>= 1u)
+            i++;
+        return i;
+#endif
+    }
+
+    uint64_t all() const { return (count == MAX_RAYS) ? ~uint64_t(0) : bit(count) - 1; }
+
+    void computeBounds()
+    {
+        coherent = (count > 0);
+        for (int a = 0; a < 3 && coherent; a++)
+        {
+            const bool negative = rays[0].direction()[a] < 0;
+            originMin[a] = originMax[a] = rays[0].origin()[a];
+            invDirMin[a] = invDirMax[a] = 1.0 / rays[0].direction()[a];
+            for (int i = 0; i < count; i++)
+            {
+                const double d = rays[i].direction()[a];
+                const double invD = 1.0 / d;
+                if (d == 0 || (d < 0) != negative || !std::isfinite(invD))
+                {
+                    coherent = false;
+                    break;
+                }
+                originMin[a] = std::fmin(originMin[a], rays[i].origin()[a]);
+                originMax[a] = std::fmax(originMax[a], rays[i].origin()[a]);
+                invDirMin[a] = std::fmin(invDirMin[a], invD);
+                invDirMax[a] = std::fmax(invDirMax[a], invD);
+            }
+        }
+    }
+
+    int count = 0;
+    Ray rays[MAX_RAYS];
+
+    bool coherent = false;
+    Vector3 originMin, originMax;
+    Vector3 invDirMin, invDirMax;
+};
+
+#endif //PATHTRACER_RAYPACKET_H
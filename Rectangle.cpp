@@ -10,8 +10,9 @@
 #include <cfloat>
 #include "Rectangle.h"
 #include "AABB.h"
+#include "Material.h"
 
-bool XYRectangle::hit(const Ray &r_in, double t0, double t1, HitRecord &rec) const
+bool XYRectangle::intersect(const Ray &r_in, double t0, double t1, SurfaceHit &hit) const
 {
     double t = (k - r_in.origin().z()) / r_in.direction().z();
     if (t < t0 || t > t1) return false;
@@ -19,14 +20,19 @@ bool XYRectangle::hit(const Ray &r_in, double t0, double t1, HitRecord &rec) con
     double y = r_in.origin().y() + t * r_in.direction().y();
     if (x < x0 || x > x1 || y < y0 || y > y1) return false;
 
-    rec.uv.u() = (x-x0)/(x1-x0);
-    rec.uv.v() = (y-y0)/(y1-y0);
-    rec.t = t;
+    hit.set(this, t, x, y);
+    return true;
+}
+
+void XYRectangle::surface(const Ray &r_in, const SurfaceHit &hit, HitRecord &rec) const
+{
+    rec.uv.u() = (hit.u-x0)/(x1-x0);
+    rec.uv.v() = (hit.v-y0)/(y1-y0);
+    rec.t = hit.t;
     rec.material = material;
-    rec.p = r_in.pointAt(t);
+    rec.p = r_in.pointAt(hit.t);
     rec.normal = Vector3(0, 0, 1);
-
-    return true;
+    rec.uvDensity = Vector2(1 / std::fabs(x1-x0), 1 / std::fabs(y1-y0));
 }
 
 bool XYRectangle::bounds(double t0, double t1, AABB &bbox) const
@@ -35,7 +41,12 @@ bool XYRectangle::bounds(double t0, double t1, AABB &bbox) const
     return true;
 }
 
-bool XZRectangle::hit(const Ray &r_in, double t0, double t1, HitRecord &rec) const
+Vector3 XYRectangle::power(const MaterialTable& materials) const
+{
+    return surfacePower(materials, material, area());
+}
+
+bool XZRectangle::intersect(const Ray &r_in, double t0, double t1, SurfaceHit &hit) const
 {
     double t = (k - r_in.origin().y()) / r_in.direction().y();
     if (t < t0 || t > t1) return false;
@@ -43,14 +54,19 @@ bool XZRectangle::hit(const Ray &r_in, double t0, double t1, HitRecord &rec) con
     double z = r_in.origin().z() + t * r_in.direction().z();
     if (x < x0 || x > x1 || z < z0 || z > z1) return false;
 
-    rec.uv.u() = (x-x0)/(x1-x0);
-    rec.uv.v() = (z-z0)/(z1-z0);
-    rec.t = t;
+    hit.set(this, t, x, z);
+    return true;
+}
+
+void XZRectangle::surface(const Ray &r_in, const SurfaceHit &hit, HitRecord &rec) const
+{
+    rec.uv.u() = (hit.u-x0)/(x1-x0);
+    rec.uv.v() = (hit.v-z0)/(z1-z0);
+    rec.t = hit.t;
     rec.material = material;
-    rec.p = r_in.pointAt(t);
+    rec.p = r_in.pointAt(hit.t);
     rec.normal = Vector3(0, 1, 0);
-
-    return true;
+    rec.uvDensity = Vector2(1 / std::fabs(x1-x0), 1 / std::fabs(z1-z0));
 }
 
 bool XZRectangle::bounds(double t0, double t1, AABB &bbox) const
@@ -59,7 +75,12 @@ bool XZRectangle::bounds(double t0, double t1, AABB &bbox) const
     return true;
 }
 
-bool YZRectangle::hit(const Ray &r_in, double t0, double t1, HitRecord &rec) const
+Vector3 XZRectangle::power(const MaterialTable& materials) const
+{
+    return surfacePower(materials, material, area());
+}
+
+bool YZRectangle::intersect(const Ray &r_in, double t0, double t1, SurfaceHit &hit) const
 {
     double t = (k - r_in.origin().x()) / r_in.direction().x();
     if (t < t0 || t > t1) return false;
@@ -67,14 +88,19 @@ bool YZRectangle::hit(const Ray &r_in, double t0, double t1, HitRecord &rec) con
     double z = r_in.origin().z() + t * r_in.direction().z();
     if (y < y0 || y > y1 || z < z0 || z > z1) return false;
 
-    rec.uv.u() = (y-y0)/(y1-y0);
-    rec.uv.v() = (z-z0)/(z1-z0);
-    rec.t = t;
+    hit.set(this, t, y, z);
+    return true;
+}
+
+void YZRectangle::surface(const Ray &r_in, const SurfaceHit &hit, HitRecord &rec) const
+{
+    rec.uv.u() = (hit.u-y0)/(y1-y0);
+    rec.uv.v() = (hit.v-z0)/(z1-z0);
+    rec.t = hit.t;
     rec.material = material;
-    rec.p = r_in.pointAt(t);
+    rec.p = r_in.pointAt(hit.t);
     rec.normal = Vector3(1, 0, 0);
-
-    return true;
+    rec.uvDensity = Vector2(1 / std::fabs(y1-y0), 1 / std::fabs(z1-z0));
 }
 
 bool YZRectangle::bounds(double t0, double t1, AABB &bbox) const
@@ -83,23 +109,28 @@ bool YZRectangle::bounds(double t0, double t1, AABB &bbox) const
     return true;
 }
 
-Box::Box(const Vector3 &p0, const Vector3 &p1, Material *mat) :
+Vector3 YZRectangle::power(const MaterialTable& materials) const
+{
+    return surfacePower(materials, material, area());
+}
+
+Box::Box(const Vector3 &p0, const Vector3 &p1, MaterialId mat, Arena& arena) :
     pmin(p0),
     pmax(p1)
 {
     std::vector<Hitable*> hl;
-    hl.push_back(new XYRectangle(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), mat));
-    hl.push_back(new FlipNormals(new XYRectangle(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), mat)));
-    hl.push_back(new XZRectangle(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), mat));
-    hl.push_back(new FlipNormals(new XZRectangle(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), mat)));
-    hl.push_back(new YZRectangle(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), mat));
-    hl.push_back(new FlipNormals(new YZRectangle(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), mat)));
-    child = new HitableList(hl);
+    hl.push_back(arena.make<XYRectangle>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), mat));
+    hl.push_back(arena.make<FlipNormals>(arena.make<XYRectangle>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), mat)));
+    hl.push_back(arena.make<XZRectangle>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), mat));
+    hl.push_back(arena.make<FlipNormals>(arena.make<XZRectangle>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), mat)));
+    hl.push_back(arena.make<YZRectangle>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), mat));
+    hl.push_back(arena.make<FlipNormals>(arena.make<YZRectangle>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), mat)));
+    child = arena.make<HitableList>(hl);
 }
 
-bool Box::hit(const Ray &r_in, double t0, double t1, HitRecord &rec) const
+bool Box::intersect(const Ray &r_in, double t0, double t1, SurfaceHit &hit) const
 {
-    return child->hit(r_in, t0, t1, rec);
+    return child->intersect(r_in, t0, t1, hit);
 }
 
 bool Box::bounds(double t0, double t1, AABB &bbox) const
@@ -111,10 +142,35 @@ bool Box::bounds(double t0, double t1, AABB &bbox) const
 RotateY::RotateY(Hitable *p, double angle)
 {
     hitable = p;
+    setAngle(angle);
+}
+
+bool RotateY::setFrame(double frame)
+{
+    const bool animated = hitable->setFrame(frame);
+    if (track != nullptr)
+        setAngle(track->at(frame));
+    else if (animated)
+        setAngle(angle);
+    return animated || track != nullptr;
+}
+
+bool Translate::setFrame(double frame)
+{
+    const bool animated = hitable->setFrame(frame);
+    if (track != nullptr)
+        offset = track->at(frame);
+    return animated || track != nullptr;
+}
+
+// The rotation, and the box around the rotated child.
+void RotateY::setAngle(double degrees)
+{
+    angle = degrees;
     double radians = (M_PI / 180.0) * angle;
     sinTheta = sin(radians);
     cosTheta = cos(radians);
-    hasBox = p->bounds(0, 1, bbox);
+    hasBox = hitable->bounds(0, 1, bbox);
     Vector3 min(DBL_MAX, DBL_MAX, DBL_MAX);
     Vector3 max(-DBL_MAX, -DBL_MAX, -DBL_MAX);
     for (int i = 0; i < 2; i++)
@@ -142,10 +198,41 @@ RotateY::RotateY(Hitable *p, double angle)
     bbox = AABB(min, max);
 }
 
-bool RotateY::hit(const Ray &r_in, double t0, double t1, HitRecord &rec) const
+double RotateY::pdfValue(const Vector3& o, const Vector3& v) const
 {
-    Vector3 origin = r_in.origin();
-    Vector3 direction = r_in.direction();
+    return hitable->pdfValue(toLocal(o), toLocal(v));
+}
+
+Vector3 RotateY::random(const Vector3& o, Sampler& sampler) const
+{
+    return toWorld(hitable->random(toLocal(o), sampler));
+}
+
+void RotateY::collectLights(std::vector<Hitable*>& lights, const MaterialTable& materials, Arena& arena)
+{
+    std::vector<Hitable*> local;
+    hitable->collectLights(local, materials, arena);
+    for (auto light : local)
+    {
+        lights.push_back(arena.make<RotateY>(light, angle));
+    }
+}
+
+void Translate::collectLights(std::vector<Hitable*>& lights, const MaterialTable& materials, Arena& arena)
+{
+    std::vector<Hitable*> local;
+    hitable->collectLights(local, materials, arena);
+    for (auto light : local)
+    {
+        lights.push_back(arena.make<Translate>(light, offset));
+    }
+}
+
+Ray RotateY::rayToInstance(const Ray &r_in) const
+{
+    Ray rotated(r_in);
+    Vector3& origin = rotated.origin();
+    Vector3& direction = rotated.direction();
 
     origin[0] = cosTheta*r_in.origin()[0] - sinTheta*r_in.origin()[2];
     origin[2] = sinTheta*r_in.origin()[0] + cosTheta*r_in.origin()[2];
@@ -153,18 +240,28 @@ bool RotateY::hit(const Ray &r_in, double t0, double t1, HitRecord &rec) const
     direction[0] = cosTheta*r_in.direction()[0] - sinTheta*r_in.direction()[2];
     direction[2] = sinTheta*r_in.direction()[0] + cosTheta*r_in.direction()[2];
 
-    Ray rotatedR(origin, direction, r_in.time());
-    if (hitable->hit(rotatedR, t0, t1, rec))
+    return rotated;
+}
+
+void RotateY::recordFromInstance(HitRecord &rec) const
+{
+    Vector3 p = rec.p;
+    Vector3 normal = rec.normal;
+    p[0] = cosTheta*rec.p[0] + sinTheta*rec.p[2];
+    p[2] = -sinTheta*rec.p[0] + cosTheta*rec.p[2];
+    normal[0] = cosTheta*rec.normal[0] + sinTheta*rec.normal[2];
+    normal[2] = -sinTheta*rec.normal[0] + cosTheta*rec.normal[2];
+    rec.p = p;
+    rec.normal = normal;
+}
+
+bool RotateY::intersect(const Ray &r_in, double t0, double t1, SurfaceHit &hit) const
+{
+    if (hitable->intersect(rayToInstance(r_in), t0, t1, hit))
     {
-        Vector3 p = rec.p;
-        Vector3 normal = rec.normal;
-        p[0] = cosTheta*rec.p[0] + sinTheta*rec.p[2];
-        p[2] = -sinTheta*rec.p[0] + cosTheta*rec.p[2];
-        normal[0] = cosTheta*rec.normal[0] + sinTheta*rec.normal[2];
-        normal[2] = -sinTheta*rec.normal[0] + cosTheta*rec.normal[2];
-        rec.p = p;
-        rec.normal = normal;
+        hit.pushInstance(this);
         return true;
     }
     return false;
 }
+
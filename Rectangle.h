@@ -10,16 +10,19 @@
 #ifndef PATHTRACER_RECTANGLE_H
 #define PATHTRACER_RECTANGLE_H
 
+#include <cfloat>
 #include "Hitable.h"
 #include "HitableList.h"
 #include "AABB.h"
+#include "Sampler.h"
+#include "Animation.h"
 
 class XYRectangle : public Hitable
 {
 public:
     XYRectangle() = default;
 
-    XYRectangle(double X0, double X1, double Y0, double Y1, double K, Material* mat) :
+    XYRectangle(double X0, double X1, double Y0, double Y1, double K, MaterialId mat) :
         material(mat),
         x0(X0),
         x1(X1),
@@ -27,12 +30,41 @@ public:
         y1(Y1),
         k(K) {}
 
-    bool hit(const Ray& r_in, double t0, double t1, HitRecord& rec) const override;
+    bool intersect(const Ray& r_in, double t0, double t1, SurfaceHit& hit) const override;
+
+    void surface(const Ray& r_in, const SurfaceHit& hit, HitRecord& rec) const override;
 
     bool bounds(double t0, double t1, AABB& bbox) const override;
 
+    double pdfValue(const Vector3& o, const Vector3& v) const override
+    {
+        HitRecord rec;
+        if (hit(Ray(o, v), 0.001, DBL_MAX, rec))
+        {
+            double distSqrd = rec.t * rec.t * v.squared_length();
+            double cosine = fabs(dot(v, rec.normal) / v.length());
+            return distSqrd / (cosine * area());
+        }
+        else
+            return 0;
+    }
+
+    Vector3 random(const Vector3& o, Sampler& sampler) const override
+    {
+        Vector2 u = sampler.get2D();
+        Vector3 randPoint = Vector3(x0 + u.x() * (x1-x0), y0 + u.y() * (y1-y0), k);
+        return randPoint - o;
+    }
+
+    double area() const override
+    { return (x1-x0) * (y1-y0); }
+
+    Vector3 power(const MaterialTable& materials) const override;
+
 private:
-    Material* material{};
+    friend class ScenePackageWriter;
+
+    MaterialId material{};
     double x0{}, x1{}, y0{}, y1{}, k{};
 };
 
@@ -41,7 +73,7 @@ class XZRectangle : public Hitable
 public:
     XZRectangle() = default;
 
-    XZRectangle(double X0, double X1, double Z0, double Z1, double K, Material* mat) :
+    XZRectangle(double X0, double X1, double Z0, double Z1, double K, MaterialId mat) :
         material(mat),
         x0(X0),
         x1(X1),
@@ -49,7 +81,9 @@ public:
         z1(Z1),
         k(K) {}
 
-    bool hit(const Ray& r_in, double t0, double t1, HitRecord& rec) const override;
+    bool intersect(const Ray& r_in, double t0, double t1, SurfaceHit& hit) const override;
+
+    void surface(const Ray& r_in, const SurfaceHit& hit, HitRecord& rec) const override;
 
     bool bounds(double t0, double t1, AABB& bbox) const override;
 
@@ -58,23 +92,30 @@ public:
         HitRecord rec;
         if (hit(Ray(o, v), 0.001, DBL_MAX, rec))
         {
-            double area = (x1-x0) * (z1-z0);
             double distSqrd = rec.t * rec.t * v.squared_length();
             double cosine = fabs(dot(v, rec.normal) / v.length());
-            return distSqrd / (cosine * area);
+            return distSqrd / (cosine * area());
         }
         else
             return 0;
     }
 
-    Vector3 random(const Vector3& o) const override
+    Vector3 random(const Vector3& o, Sampler& sampler) const override
     {
-        Vector3 randPoint = Vector3(x0 + drand48() * (x1-x0), k, z0 + drand48() * (z1-z0));
+        Vector2 u = sampler.get2D();
+        Vector3 randPoint = Vector3(x0 + u.x() * (x1-x0), k, z0 + u.y() * (z1-z0));
         return randPoint - o;
     }
 
+    double area() const override
+    { return (x1-x0) * (z1-z0); }
+
+    Vector3 power(const MaterialTable& materials) const override;
+
 private:
-    Material* material{};
+    friend class ScenePackageWriter;
+
+    MaterialId material{};
     double x0{}, x1{}, z0{}, z1{}, k{};
 };
 
@@ -83,7 +124,7 @@ class YZRectangle : public Hitable
 public:
     YZRectangle() = default;
 
-    YZRectangle(double Y0, double Y1, double Z0, double Z1, double K, Material* mat) :
+    YZRectangle(double Y0, double Y1, double Z0, double Z1, double K, MaterialId mat) :
         material(mat),
         y0(Y0),
         y1(Y1),
@@ -91,12 +132,41 @@ public:
         z1(Z1),
         k(K) {}
 
-    bool hit(const Ray& r_in, double t0, double t1, HitRecord& rec) const override;
+    bool intersect(const Ray& r_in, double t0, double t1, SurfaceHit& hit) const override;
+
+    void surface(const Ray& r_in, const SurfaceHit& hit, HitRecord& rec) const override;
 
     bool bounds(double t0, double t1, AABB& bbox) const override;
 
+    double pdfValue(const Vector3& o, const Vector3& v) const override
+    {
+        HitRecord rec;
+        if (hit(Ray(o, v), 0.001, DBL_MAX, rec))
+        {
+            double distSqrd = rec.t * rec.t * v.squared_length();
+            double cosine = fabs(dot(v, rec.normal) / v.length());
+            return distSqrd / (cosine * area());
+        }
+        else
+            return 0;
+    }
+
+    Vector3 random(const Vector3& o, Sampler& sampler) const override
+    {
+        Vector2 u = sampler.get2D();
+        Vector3 randPoint = Vector3(k, y0 + u.x() * (y1-y0), z0 + u.y() * (z1-z0));
+        return randPoint - o;
+    }
+
+    double area() const override
+    { return (y1-y0) * (z1-z0); }
+
+    Vector3 power(const MaterialTable& materials) const override;
+
 private:
-    Material* material{};
+    friend class ScenePackageWriter;
+
+    MaterialId material{};
     double y0{}, y1{}, z0{}, z1{}, k{};
 };
 
@@ -106,11 +176,11 @@ public:
     explicit FlipNormals(Hitable* p) :
         hitable(p) {}
 
-    bool hit(const Ray& r_in, double t0, double t1, HitRecord& rec) const override
+    bool intersect(const Ray& r_in, double t0, double t1, SurfaceHit& hit) const override
     {
-        if (hitable->hit(r_in, t0, t1, rec))
+        if (hitable->intersect(r_in, t0, t1, hit))
         {
-            rec.normal = -rec.normal;
+            hit.flipNormal = !hit.flipNormal;
             return true;
         }
         return false;
@@ -124,7 +194,22 @@ public:
     int numChildren() const override
     { return 1 + hitable->numChildren(); }
 
+    double area() const override
+    { return hitable->area(); }
+
+    Vector3 power(const MaterialTable& materials) const override
+    { return hitable->power(materials); }
+
+    // Sampling does not depend on the facing of the surface.
+    void collectLights(std::vector<Hitable*>& lights, const MaterialTable& materials, Arena& arena) override
+    { hitable->collectLights(lights, materials, arena); }
+
+    bool setFrame(double frame) override
+    { return hitable->setFrame(frame); }
+
 private:
+    friend class ScenePackageWriter;
+
     Hitable* hitable;
 };
 
@@ -133,16 +218,33 @@ class Box : public Hitable
 public:
     Box() = default;
 
-    Box(const Vector3& p0, const Vector3& p1, Material* mat);
+    Box(const Vector3& p0, const Vector3& p1, MaterialId mat, Arena& arena);
+
+    // With its sides already made, as loaded from a scene package.
+    Box(const Vector3& p0, const Vector3& p1, Hitable* sides) :
+        pmin(p0),
+        pmax(p1),
+        child(sides) { }
 
-    bool hit(const Ray& r_in, double t0, double t1, HitRecord& rec) const override;
+    bool intersect(const Ray& r_in, double t0, double t1, SurfaceHit& hit) const override;
 
     bool bounds(double t0, double t1, AABB& bbox) const override;
 
     int numChildren() const override
     { return 1 + child->numChildren(); }
 
+    double area() const override
+    { return child->area(); }
+
+    Vector3 power(const MaterialTable& materials) const override
+    { return child->power(materials); }
+
+    void collectLights(std::vector<Hitable*>& lights, const MaterialTable& materials, Arena& arena) override
+    { child->collectLights(lights, materials, arena); }
+
 private:
+    friend class ScenePackageWriter;
+
     Vector3 pmin{}, pmax{};
     Hitable* child{};
 };
@@ -155,17 +257,30 @@ public:
         offset(displacement)
     {}
 
-    bool hit(const Ray &r_in, double t0, double t1, HitRecord &rec) const override
+    // Keys the offset over the frames of an animation.
+    void animate(const Track<Vector3>* offsets)
+    { track = offsets; }
+
+    bool intersect(const Ray &r_in, double t0, double t1, SurfaceHit &hit) const override
     {
-        Ray movedR(r_in.origin() - offset, r_in.direction(), r_in.time());
-        if (hitable->hit(movedR, t0, t1, rec))
+        if (hitable->intersect(rayToInstance(r_in), t0, t1, hit))
         {
-            rec.p += offset;
+            hit.pushInstance(this);
             return true;
         }
         return false;
     }
 
+    Ray rayToInstance(const Ray &r_in) const override
+    {
+        Ray moved(r_in);
+        moved.origin() -= offset;
+        return moved;
+    }
+
+    void recordFromInstance(HitRecord &rec) const override
+    { rec.p += offset; }
+
     bool bounds(double t0, double t1, AABB &bbox) const override
     {
         if (hitable->bounds(t0, t1, bbox))
@@ -179,9 +294,28 @@ public:
     int numChildren() const override
     { return 1 + hitable->numChildren(); }
 
+    double pdfValue(const Vector3& o, const Vector3& v) const override
+    { return hitable->pdfValue(o - offset, v); }
+
+    Vector3 random(const Vector3& o, Sampler& sampler) const override
+    { return hitable->random(o - offset, sampler); }
+
+    double area() const override
+    { return hitable->area(); }
+
+    Vector3 power(const MaterialTable& materials) const override
+    { return hitable->power(materials); }
+
+    void collectLights(std::vector<Hitable*>& lights, const MaterialTable& materials, Arena& arena) override;
+
+    bool setFrame(double frame) override;
+
 private:
+    friend class ScenePackageWriter;
+
     Hitable* hitable;
     Vector3 offset;
+    const Track<Vector3>* track = nullptr;
 };
 
 class RotateY : public Hitable
@@ -189,7 +323,15 @@ class RotateY : public Hitable
 public:
     RotateY(Hitable* p, double angle);
 
-    bool hit(const Ray& r_in, double t0, double t1, HitRecord& rec) const override;
+    // Keys the angle over the frames of an animation.
+    void animate(const Track<double>* angles)
+    { track = angles; }
+
+    bool intersect(const Ray& r_in, double t0, double t1, SurfaceHit& hit) const override;
+
+    Ray rayToInstance(const Ray& r_in) const override;
+
+    void recordFromInstance(HitRecord& rec) const override;
 
     bool bounds(double t0, double t1, AABB& bbox) const override
     {
@@ -200,11 +342,37 @@ public:
     int numChildren() const override
     { return 1 + hitable->numChildren(); }
 
+    double area() const override
+    { return hitable->area(); }
+
+    Vector3 power(const MaterialTable& materials) const override
+    { return hitable->power(materials); }
+
+    double pdfValue(const Vector3& o, const Vector3& v) const override;
+
+    Vector3 random(const Vector3& o, Sampler& sampler) const override;
+
+    void collectLights(std::vector<Hitable*>& lights, const MaterialTable& materials, Arena& arena) override;
+
+    bool setFrame(double frame) override;
+
 private:
+    friend class ScenePackageWriter;
+
+    void setAngle(double degrees);
+
+    Vector3 toLocal(const Vector3& v) const
+    { return {cosTheta*v.x() - sinTheta*v.z(), v.y(), sinTheta*v.x() + cosTheta*v.z()}; }
+
+    Vector3 toWorld(const Vector3& v) const
+    { return {cosTheta*v.x() + sinTheta*v.z(), v.y(), -sinTheta*v.x() + cosTheta*v.z()}; }
+
     Hitable* hitable;
+    double angle;
     double sinTheta, cosTheta;
     bool hasBox;
     AABB bbox;
+    const Track<double>* track = nullptr;
 };
 
 #endif //PATHTRACER_RECTANGLE_H
@@ -0,0 +1,269 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "Sampler.h"
+
+static const int BLUE_NOISE_SIZE = 64;
+
+static uint32_t reverseBits(uint32_t x)
+{
+    x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+    x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+    x = ((x >> 4u) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4u);
+    x = ((x >> 8u) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8u);
+    return (x >> 16u) | (x << 16u);
+}
+
+static uint32_t hash32(uint64_t a, uint64_t b)
+{
+    return static_cast<uint32_t>(mixBits(a ^ mixBits(b + 0x9e3779b97f4a7c15ULL)));
+}
+
+// First two dimensions of the Sobol sequence; the first is van der Corput.
+static uint32_t sobol(uint32_t index, int dim)
+{
+    if (dim == 0)
+        return reverseBits(index);
+
+    uint32_t r = 0;
+    for (uint32_t v = 1u << 31u; index; index >>= 1u, v ^= v >> 1u)
+    {
+        if (index & 1u)
+            r ^= v;
+    }
+    return r;
+}
+
+static uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+{
+    return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+static double toUnit(uint32_t x)
+{
+    return x * (1.0 / 4294967296.0);
+}
+
+//
+// Blue-noise dither mask built with the void-and-cluster method.
+//
+// Robert Ulichney, "The void-and-cluster method for dither array generation",
+// Proc. SPIE 1913, 1993.
+//
+static std::vector<float> generateBlueNoise(int size)
+{
+    const int n = size * size;
+    const double sigma = 1.5;
+
+    // Toroidal gaussian energy filter.
+    std::vector<double> filter(n);
+    for (int dy = 0; dy < size; dy++)
+    {
+        for (int dx = 0; dx < size; dx++)
+        {
+            int x = std::min(dx, size - dx);
+            int y = std::min(dy, size - dy);
+            filter[dy * size + dx] = exp(-(x * x + y * y) / (2 * sigma * sigma));
+        }
+    }
+
+    std::vector<char> pattern(n, 0);
+    std::vector<double> energy(n, 0.0);
+    auto splat = [&](int i, double sign)
+    {
+        const int px = i % size, py = i / size;
+        for (int y = 0; y < size; y++)
+        {
+            const int fy = ((y - py + size) % size) * size;
+            for (int x = 0; x < size; x++)
+                energy[y * size + x] += sign * filter[fy + (x - px + size) % size];
+        }
+    };
+    auto tightestCluster = [&](char value)
+    {
+        int best = -1;
+        for (int i = 0; i < n; i++)
+            if (pattern[i] == value && (best < 0 || energy[i] > energy[best])) best = i;
+        return best;
+    };
+    auto largestVoid = [&](char value)
+    {
+        int best = -1;
+        for (int i = 0; i < n; i++)
+            if (pattern[i] == value && (best < 0 || energy[i] < energy[best])) best = i;
+        return best;
+    };
+
+    // Initial binary pattern: ~10% random points, relaxed until the tightest
+    // cluster is also the largest void.
+    Random rng(0xb1e5);
+    int ones = 0;
+    while (ones < n / 10)
+    {
+        auto i = int(rng.nextDouble() * n);
+        if (!pattern[i])
+        {
+            pattern[i] = 1;
+            splat(i, 1);
+            ones++;
+        }
+    }
+    for (;;)
+    {
+        int cluster = tightestCluster(1);
+        pattern[cluster] = 0;
+        splat(cluster, -1);
+        int hole = largestVoid(0);
+        pattern[hole] = 1;
+        splat(hole, 1);
+        if (hole == cluster) break;
+    }
+
+    std::vector<int> rank(n, 0);
+    const std::vector<char> initial = pattern;
+    const std::vector<double> initialEnergy = energy;
+
+    // Phase 1: rank the initial points by removing tightest clusters.
+    for (int r = ones - 1; r >= 0; r--)
+    {
+        int cluster = tightestCluster(1);
+        pattern[cluster] = 0;
+        splat(cluster, -1);
+        rank[cluster] = r;
+    }
+
+    // Phase 2: fill the largest voids up to half full.
+    pattern = initial;
+    energy = initialEnergy;
+    int r = ones;
+    for (; r < n / 2; r++)
+    {
+        int hole = largestVoid(0);
+        pattern[hole] = 1;
+        splat(hole, 1);
+        rank[hole] = r;
+    }
+
+    // Phase 3: with the roles reversed, fill the tightest clusters of zeros.
+    std::fill(energy.begin(), energy.end(), 0.0);
+    for (int i = 0; i < n; i++)
+        if (!pattern[i]) splat(i, 1);
+    for (; r < n; r++)
+    {
+        int cluster = tightestCluster(0);
+        pattern[cluster] = 1;
+        splat(cluster, -1);
+        rank[cluster] = r;
+    }
+
+    std::vector<float> mask(n);
+    for (int i = 0; i < n; i++)
+        mask[i] = (rank[i] + 0.5f) / n;
+    return mask;
+}
+
+Sampler* Sampler::create(const std::string& name, int width, uint64_t seed, bool deterministic)
+{
+    if (name == "random")
+        return new RandomSampler(width, seed, deterministic);
+    if (name == "sobol")
+        return new SobolSampler(seed);
+    if (name == "bluenoise")
+        return new BlueNoiseSampler(seed);
+    return nullptr;
+}
+
+void RandomSampler::startSample(int x, int y, int sampleIndex)
+{
+    Sampler::startSample(x, y, sampleIndex);
+
+    const uint64_t pixel = uint64_t(y) * m_width + x;
+    if (m_deterministic)
+    {
+        m_rng = Random::forSample(m_seed, pixel, sampleIndex);
+    }
+    else if (pixel != m_pixel)
+    {
+        // A pixel resumed part-way through, by a later adaptive pass, starts
+        // at a different point of its stream rather than repeating it.
+        m_rng = Random(pixel, (sampleIndex == 0) ? m_seed : mixBits(m_seed + uint64_t(sampleIndex)));
+        m_pixel = pixel;
+    }
+}
+
+uint32_t SobolSampler::dimensionSeed(int dim) const
+{
+    return hash32(hash32(m_seed, (uint64_t(uint32_t(m_y)) << 32u) | uint32_t(m_x)), dim);
+}
+
+double SobolSampler::sample1D(int dim)
+{
+    const uint32_t seed = dimensionSeed(dim);
+    const uint32_t index = nestedUniformScramble(m_sampleIndex, seed);
+    return toUnit(nestedUniformScramble(sobol(index, 0), hash32(seed, 0)));
+}
+
+Vector2 SobolSampler::sample2D(int dim)
+{
+    const uint32_t seed = dimensionSeed(dim);
+    const uint32_t index = nestedUniformScramble(m_sampleIndex, seed);
+    return {toUnit(nestedUniformScramble(sobol(index, 0), hash32(seed, 1))),
+            toUnit(nestedUniformScramble(sobol(index, 1), hash32(seed, 2)))};
+}
+
+BlueNoiseSampler::BlueNoiseSampler(uint64_t seed) :
+    SobolSampler(seed)
+{
+    static const std::vector<float> mask = generateBlueNoise(BLUE_NOISE_SIZE);
+    m_mask = mask.data();
+}
+
+uint32_t BlueNoiseSampler::dimensionSeed(int dim) const
+{
+    return hash32(m_seed, dim);
+}
+
+double BlueNoiseSampler::rotation(int dim) const
+{
+    // Each dimension reads the mask at a different toroidal offset.
+    const uint32_t h = hash32(m_seed ^ 0xd1ce, dim);
+    const int x = (m_x + int(h & 0xffffu)) % BLUE_NOISE_SIZE;
+    const int y = (m_y + int(h >> 16u)) % BLUE_NOISE_SIZE;
+    return m_mask[y * BLUE_NOISE_SIZE + x];
+}
+
+double BlueNoiseSampler::sample1D(int dim)
+{
+    double u = SobolSampler::sample1D(dim) + rotation(dim);
+    return u < 1 ? u : u - 1;
+}
+
+Vector2 BlueNoiseSampler::sample2D(int dim)
+{
+    Vector2 u = SobolSampler::sample2D(dim);
+    for (int i = 0; i < 2; i++)
+    {
+        u[i] += rotation(dim + i);
+        if (u[i] >= 1) u[i] -= 1;
+    }
+    return u;
+}
@@ -0,0 +1,197 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_SAMPLER_H
+#define PATHTRACER_SAMPLER_H
+
+#include <string>
+#include "Vector2.h"
+#include "Random.h"
+
+//
+// Dimension layout shared by every sampler.  The camera always draws its
+// values from the first few dimensions and every bounce starts at a fixed
+// offset, so a given role (lens, time, light selection, BSDF, ...) always maps
+// to the same dimension of the underlying sequence.
+//
+namespace SampleDim
+{
+    const int PixelJitter = 0;  // 2D
+    const int Lens = 2;         // 2D
+    const int Time = 4;         // 1D
+    const int FirstBounce = 5;
+
+    // Offsets within a bounce.
+    const int Scatter = 0;      // 2D + 1D: material decisions (fuzz, reflect/refract)
+    const int LightSelect = 3;  // 1D, followed by the 2D point on the light
+    const int Bsdf = 6;         // 2D
+    const int Roulette = 8;     // 1D
+    const int Medium = 9;       // 1D: free flight of the ray leaving the previous vertex (the camera at depth 0)
+    const int ShadowMedium = 10;    // 1D: free flight of the light sample's shadow ray
+    const int PerBounce = 11;
+
+    inline int bounce(int depth, int offset)
+    {
+        return FirstBounce + depth * PerBounce + offset;
+    }
+}
+
+class Sampler
+{
+public:
+    virtual ~Sampler() = default;
+
+    // Begin sample 'sampleIndex' of pixel (x, y).  Resets the dimension to 0.
+    virtual void startSample(int x, int y, int sampleIndex)
+    {
+        m_x = x;
+        m_y = y;
+        m_sampleIndex = sampleIndex;
+        m_dimension = 0;
+    }
+
+    void setDimension(int dim) { m_dimension = dim; }
+
+    // Position of a sample in its sequence, for integrators that advance
+    // many samples in turn on one sampler.
+    struct State
+    {
+        int x, y;
+        int sampleIndex;
+        int dimension;
+        Random rng;
+    };
+
+    virtual void saveState(State& state) const
+    {
+        state.x = m_x;
+        state.y = m_y;
+        state.sampleIndex = m_sampleIndex;
+        state.dimension = m_dimension;
+    }
+
+    virtual void restoreState(const State& state)
+    {
+        m_x = state.x;
+        m_y = state.y;
+        m_sampleIndex = state.sampleIndex;
+        m_dimension = state.dimension;
+    }
+
+    // The next value(s) in [0, 1); each call advances the dimension.
+    double get1D() { return sample1D(m_dimension++); }
+
+    Vector2 get2D()
+    {
+        Vector2 u = sample2D(m_dimension);
+        m_dimension += 2;
+        return u;
+    }
+
+    // Factory for the samplers selectable on the command line:
+    // "random", "sobol" or "bluenoise".  Returns nullptr for unknown names.
+    static Sampler* create(const std::string& name, int width, uint64_t seed, bool deterministic);
+
+protected:
+    virtual double sample1D(int dim) = 0;
+    virtual Vector2 sample2D(int dim) = 0;
+
+    int m_x = 0, m_y = 0;
+    int m_sampleIndex = 0;
+    int m_dimension = 0;
+};
+
+//
+// Independent uniform random numbers - the original behaviour.  One PCG32
+// stream per pixel, or one per sample in deterministic mode.
+//
+class RandomSampler : public Sampler
+{
+public:
+    RandomSampler(int width, uint64_t seed, bool deterministic) :
+        m_width(width),
+        m_seed(seed),
+        m_deterministic(deterministic) {}
+
+    void startSample(int x, int y, int sampleIndex) override;
+
+    void saveState(State& state) const override
+    {
+        Sampler::saveState(state);
+        state.rng = m_rng;
+    }
+
+    void restoreState(const State& state) override
+    {
+        Sampler::restoreState(state);
+        m_rng = state.rng;
+        m_pixel = uint64_t(state.y) * m_width + state.x;
+    }
+
+protected:
+    double sample1D(int dim) override { return m_rng.nextDouble(); }
+    Vector2 sample2D(int dim) override
+    {
+        double u = m_rng.nextDouble();
+        return {u, m_rng.nextDouble()};
+    }
+
+private:
+    Random m_rng;
+    int m_width;
+    uint64_t m_seed;
+    bool m_deterministic;
+    uint64_t m_pixel = ~0ULL;
+};
+
+//
+// Owen-scrambled Sobol points, padded per dimension pair with a nested
+// uniform shuffle of the sample index.
+//
+// Brent Burley, "Practical Hash-based Owen Scrambling", JCGT 9(4), 2020.
+//
+class SobolSampler : public Sampler
+{
+public:
+    explicit SobolSampler(uint64_t seed) :
+        m_seed(seed) {}
+
+protected:
+    double sample1D(int dim) override;
+    Vector2 sample2D(int dim) override;
+
+    // Seed for the scrambles of a dimension; per pixel unless overridden.
+    virtual uint32_t dimensionSeed(int dim) const;
+
+    uint64_t m_seed;
+};
+
+//
+// The same Owen-scrambled Sobol sequence in every pixel, decorrelated by a
+// per-pixel Cranley-Patterson rotation read from a tiled blue-noise mask.  The
+// residual error is then distributed as blue noise over the image.
+//
+class BlueNoiseSampler : public SobolSampler
+{
+public:
+    explicit BlueNoiseSampler(uint64_t seed);
+
+protected:
+    double sample1D(int dim) override;
+    Vector2 sample2D(int dim) override;
+
+    uint32_t dimensionSeed(int dim) const override;
+
+private:
+    double rotation(int dim) const;
+
+    const float* m_mask;
+};
+
+#endif //PATHTRACER_SAMPLER_H
@@ -0,0 +1,41 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_SCENE_H
+#define PATHTRACER_SCENE_H
+
+#include "Material.h"
+#include "AmbientLight.h"
+
+//
+// What the hitables of a scene share: the table of materials they index and
+// the light of the rays that leave the scene.
+//
+// A scene is made in the arena of its hitables and goes with them at
+// release(), so nothing outlives the scene it belongs to, and scenes loaded
+// side by side keep their materials apart.
+//
+class Scene
+{
+public:
+    Scene() = default;
+
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    MaterialTable materials;
+
+    // Black unless the scene sets one.
+    const AmbientLight* ambient = &m_black;
+
+private:
+    ConstantAmbient m_black;
+};
+
+#endif //PATHTRACER_SCENE_H
@@ -0,0 +1,643 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include "ScenePackage.h"
+#include "AmbientLight.h"
+#include "Arena.h"
+#include "BVH.h"
+#include "Camera.h"
+#include "HitableList.h"
+#include "Material.h"
+#include "Medium.h"
+#include "Rectangle.h"
+#include "Scene.h"
+#include "Sphere.h"
+#include "Texture.h"
+#include "TextureCache.h"
+#include "Triangle.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char PACKAGE_MAGIC[8] = {'P', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+static const uint32_t PACKAGE_VERSION = 2;
+static const size_t SECTION_ALIGNMENT = 64;
+
+// The camera is stored as it is in memory.
+static_assert(std::is_trivially_copyable<Camera>::value, "Camera must be trivially copyable");
+
+struct PackageSection
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct PackageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t cameraSize;
+    uint64_t fileSize;
+
+    PackageSection nodes;
+    PackageSection values;
+    PackageSection children;
+    PackageSection textures;
+    PackageSection materials;
+    PackageSection pixels;          // count in bytes; texels and paths
+
+    uint32_t root;
+    uint32_t ambient;               // 0 constant, 1 sky
+    double ambientColor[3];
+
+    unsigned char camera[sizeof(Camera)];
+};
+
+// Values a node of each type has, in NodeType order, its children, where
+// fixed, and whether it has a material.
+static const uint32_t NODE_VALUES[] = {4, 9, 5, 5, 5, 15, 0, 6, 3, 1, 0, 6, 1};
+static const int NODE_CHILDREN[] = {0, 0, 0, 0, 0, 0, 1, 1, 1, 1, -1, 2, 1};
+static const bool NODE_MATERIAL[] = {true, true, true, true, true, true, false, false, false, false, false, false, true};
+
+uint32_t ScenePackageWriter::node(const Hitable* hitable)
+{
+    auto found = m_nodeIndex.find(hitable);
+    if (found != m_nodeIndex.end())
+        return found->second;
+    const uint32_t index = packNode(hitable);
+    m_nodeIndex[hitable] = index;
+    return index;
+}
+
+uint32_t ScenePackageWriter::texture(const Texture* texture)
+{
+    auto found = m_textureIndex.find(texture);
+    if (found != m_textureIndex.end())
+        return found->second;
+    const uint32_t index = packTexture(texture);
+    m_textureIndex[texture] = index;
+    return index;
+}
+
+uint32_t ScenePackageWriter::packNode(const Hitable* hitable)
+{
+    if (auto sphere = dynamic_cast<const Sphere*>(hitable))
+    {
+        const Vector3& c = sphere->center;
+        return addNode(NodeType::Sphere, {c.x(), c.y(), c.z(), sphere->radius}, sphere->material);
+    }
+    if (auto sphere = dynamic_cast<const MovingSphere*>(hitable))
+    {
+        const Vector3& c0 = sphere->center0;
+        const Vector3& c1 = sphere->center1;
+        return addNode(NodeType::MovingSphere, {c0.x(), c0.y(), c0.z(), c1.x(), c1.y(), c1.z(),
+                                                sphere->time0, sphere->time1, sphere->radius}, sphere->material);
+    }
+    if (auto rect = dynamic_cast<const XYRectangle*>(hitable))
+        return addNode(NodeType::XYRectangle, {rect->x0, rect->x1, rect->y0, rect->y1, rect->k}, rect->material);
+    if (auto rect = dynamic_cast<const XZRectangle*>(hitable))
+        return addNode(NodeType::XZRectangle, {rect->x0, rect->x1, rect->z0, rect->z1, rect->k}, rect->material);
+    if (auto rect = dynamic_cast<const YZRectangle*>(hitable))
+        return addNode(NodeType::YZRectangle, {rect->y0, rect->y1, rect->z0, rect->z1, rect->k}, rect->material);
+    if (auto tri = dynamic_cast<const Triangle*>(hitable))
+    {
+        return addNode(NodeType::Triangle, {tri->v0.x(), tri->v0.y(), tri->v0.z(), tri->t0.u(), tri->t0.v(),
+                                            tri->v1.x(), tri->v1.y(), tri->v1.z(), tri->t1.u(), tri->t1.v(),
+                                            tri->v2.x(), tri->v2.y(), tri->v2.z(), tri->t2.u(), tri->t2.v()},
+                       tri->material);
+    }
+    if (auto flip = dynamic_cast<const FlipNormals*>(hitable))
+        return addNode(NodeType::FlipNormals, {}, 0, {node(flip->hitable)});
+    if (auto box = dynamic_cast<const Box*>(hitable))
+    {
+        const Vector3& p0 = box->pmin;
+        const Vector3& p1 = box->pmax;
+        return addNode(NodeType::Box, {p0.x(), p0.y(), p0.z(), p1.x(), p1.y(), p1.z()}, 0, {node(box->child)});
+    }
+    if (auto translate = dynamic_cast<const Translate*>(hitable))
+    {
+        if (translate->track != nullptr)
+            return fail("keyframed transforms cannot be packed");
+        const Vector3& offset = translate->offset;
+        return addNode(NodeType::Translate, {offset.x(), offset.y(), offset.z()}, 0, {node(translate->hitable)});
+    }
+    if (auto rotate = dynamic_cast<const RotateY*>(hitable))
+    {
+        if (rotate->track != nullptr)
+            return fail("keyframed transforms cannot be packed");
+        return addNode(NodeType::RotateY, {rotate->angle}, 0, {node(rotate->hitable)});
+    }
+    if (auto list = dynamic_cast<const HitableList*>(hitable))
+    {
+        std::vector<uint32_t> children;
+        children.reserve(list->list.size());
+        for (auto ip : list->list)
+            children.push_back(node(ip));
+        return addNode(NodeType::List, {}, 0, children);
+    }
+    if (auto bvh = dynamic_cast<const BVH*>(hitable))
+    {
+        const Vector3& lo = bvh->m_bbox.min();
+        const Vector3& hi = bvh->m_bbox.max();
+        return addNode(NodeType::BVH, {lo.x(), lo.y(), lo.z(), hi.x(), hi.y(), hi.z()}, 0,
+                       {node(bvh->left), node(bvh->right)});
+    }
+    if (auto medium = dynamic_cast<const ConstantMedium*>(hitable))
+        return addNode(NodeType::Medium, {medium->density}, medium->phaseFunction, {node(medium->boundary)});
+    return fail("the scene has a hitable that cannot be packed");
+}
+
+uint32_t ScenePackageWriter::packTexture(const Texture* texture)
+{
+    PackedTexture packed{TextureType::Constant, {0, 0}, 0, 0, 0, 0, {0, 0, 0}};
+    if (auto constant = dynamic_cast<const ConstantTexture*>(texture))
+    {
+        packed.values[0] = constant->color.x();
+        packed.values[1] = constant->color.y();
+        packed.values[2] = constant->color.z();
+        return addTexture(packed);
+    }
+    if (auto checker = dynamic_cast<const CheckerTexture*>(texture))
+    {
+        packed.type = TextureType::Checker;
+        packed.textures[0] = this->texture(checker->even);
+        packed.textures[1] = this->texture(checker->odd);
+        return addTexture(packed);
+    }
+    if (auto noise = dynamic_cast<const NoiseTexture*>(texture))
+    {
+        packed.type = TextureType::Noise;
+        packed.values[0] = noise->scale;
+        return addTexture(packed);
+    }
+    if (auto image = dynamic_cast<const ImageTexture*>(texture))
+    {
+        packed.width = image->nx;
+        packed.height = image->ny;
+        if (image->tiled != nullptr)
+        {
+            packed.type = TextureType::TiledImage;
+            return addTexture(packed, image->tiled->path());
+        }
+        packed.type = TextureType::Image;
+        const auto& levels = image->levels;
+        return addTexture(packed, image->data, (levels.size() > 1) ? levels[1].texels : nullptr);
+    }
+    return fail("the scene has a texture that cannot be packed");
+}
+
+uint32_t ScenePackageWriter::packMaterial(const Material& material)
+{
+    PackedMaterial packed{MaterialType::Lambertian, 0, {0, 0, 0, 0}};
+    if (auto lambertian = std::get_if<Lambertian>(&material.m_material))
+    {
+        packed.texture = texture(lambertian->albedo);
+    }
+    else if (auto metal = std::get_if<Metal>(&material.m_material))
+    {
+        packed.type = MaterialType::Metal;
+        packed.values[0] = metal->albedo.x();
+        packed.values[1] = metal->albedo.y();
+        packed.values[2] = metal->albedo.z();
+        packed.values[3] = metal->fuzz;
+    }
+    else if (auto dielectric = std::get_if<Dielectric>(&material.m_material))
+    {
+        packed.type = MaterialType::Dielectric;
+        packed.values[0] = dielectric->refIndex;
+    }
+    else if (auto light = std::get_if<DiffuseLight>(&material.m_material))
+    {
+        packed.type = MaterialType::DiffuseLight;
+        packed.texture = texture(light->emit);
+    }
+    else if (auto isotropic = std::get_if<Isotropic>(&material.m_material))
+    {
+        packed.type = MaterialType::Isotropic;
+        packed.texture = texture(isotropic->albedo);
+    }
+    return addMaterial(packed);
+}
+
+uint32_t ScenePackageWriter::addNode(NodeType type, std::initializer_list<double> values, uint32_t material,
+                                     const std::vector<uint32_t>& children)
+{
+    PackedNode node{type, material, uint32_t(m_values.size()), uint32_t(m_children.size()), uint32_t(children.size()),
+                    {}};
+    m_values.insert(m_values.end(), values);
+    m_children.insert(m_children.end(), children.begin(), children.end());
+    m_nodes.push_back(node);
+    return uint32_t(m_nodes.size() - 1);
+}
+
+uint32_t ScenePackageWriter::addTexture(const PackedTexture& texture, const unsigned char* pixels,
+                                        const unsigned char* mips)
+{
+    PackedTexture packed = texture;
+    if (texture.type == TextureType::Image)
+    {
+        // Each image starts on a cache line, as the sections do.
+        m_pixels.resize((m_pixels.size() + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT);
+        packed.pixels = m_pixels.size();
+        const size_t firstLevel = size_t(texture.width) * texture.height * 3;
+        const size_t size = ImageTexture::pyramidSize(texture.width, texture.height);
+        if (pixels != nullptr)
+            m_pixels.insert(m_pixels.end(), pixels, pixels + firstLevel);
+        else
+            m_pixels.resize(m_pixels.size() + firstLevel);
+        if (mips != nullptr)
+            m_pixels.insert(m_pixels.end(), mips, mips + (size - firstLevel));
+        else
+            m_pixels.resize(m_pixels.size() + (size - firstLevel));
+    }
+    m_textures.push_back(packed);
+    return uint32_t(m_textures.size() - 1);
+}
+
+uint32_t ScenePackageWriter::addTexture(const PackedTexture& texture, const std::string& path)
+{
+    PackedTexture packed = texture;
+    packed.pixels = m_pixels.size();
+    m_pixels.insert(m_pixels.end(), path.begin(), path.end());
+    m_pixels.push_back('\0');
+    m_textures.push_back(packed);
+    return uint32_t(m_textures.size() - 1);
+}
+
+uint32_t ScenePackageWriter::addMaterial(const PackedMaterial& material)
+{
+    m_materials.push_back(material);
+    return uint32_t(m_materials.size() - 1);
+}
+
+uint32_t ScenePackageWriter::fail(const std::string& message)
+{
+    if (m_error.empty())
+        m_error = message;
+    return 0;
+}
+
+template <typename T>
+static void writeSection(std::ofstream& out, PackageSection& section, const std::vector<T>& records)
+{
+    const auto position = uint64_t(out.tellp());
+    const uint64_t offset = (position + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+    for (uint64_t i = position; i < offset; i++)
+        out.put('\0');
+    section.offset = offset;
+    section.count = records.size();
+    out.write(reinterpret_cast<const char*>(records.data()), std::streamsize(records.size() * sizeof(T)));
+}
+
+bool ScenePackageWriter::write(const std::string& path, const Hitable* world, const Camera& camera,
+                               const Scene& scene, std::string& error)
+{
+    // The material ids in the nodes are indices into the table, so it is
+    // written whole and in order.
+    for (size_t i = 0; i < scene.materials.size(); i++)
+        packMaterial(scene.materials[MaterialId(i)]);
+    const uint32_t root = node(world);
+    if (!m_error.empty())
+    {
+        error = "Unable to package the scene: " + m_error + ".";
+        return false;
+    }
+
+    PackageHeader header{};
+    memcpy(header.magic, PACKAGE_MAGIC, sizeof(header.magic));
+    header.version = PACKAGE_VERSION;
+    header.cameraSize = sizeof(Camera);
+    header.root = root;
+    const AmbientLight* ambient = scene.ambient;
+    if (dynamic_cast<const SkyAmbient*>(ambient) != nullptr)
+    {
+        header.ambient = 1;
+    }
+    else
+    {
+        // Anything else is constant, and the same for any ray.
+        const Vector3 color = ambient->emitted(Ray(Vector3(0, 0, 0), Vector3(0, 0, 1)));
+        for (int i = 0; i < 3; i++)
+            header.ambientColor[i] = color[i];
+    }
+    memcpy(header.camera, &camera, sizeof(Camera));
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        error = "Unable to write " + path + ".";
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeSection(out, header.nodes, m_nodes);
+    writeSection(out, header.values, m_values);
+    writeSection(out, header.children, m_children);
+    writeSection(out, header.textures, m_textures);
+    writeSection(out, header.materials, m_materials);
+    writeSection(out, header.pixels, m_pixels);
+    header.fileSize = uint64_t(out.tellp());
+
+    // Now that the sections are placed.
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!out)
+    {
+        error = "Unable to write " + path + ".";
+        return false;
+    }
+    return true;
+}
+
+bool isScenePackage(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(PACKAGE_MAGIC)];
+    return in.read(magic, sizeof(magic)) && memcmp(magic, PACKAGE_MAGIC, sizeof(magic)) == 0;
+}
+
+//
+// The file contents for as long as the scene lives: mapped where the system
+// can, otherwise read into memory.
+//
+class PackageFile
+{
+public:
+    ~PackageFile()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (m_data != nullptr)
+            munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+    }
+
+    bool open(const std::string& path)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info{};
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            return false;
+        m_data = static_cast<const unsigned char*>(data);
+        m_size = size_t(info.st_size);
+        return true;
+#else
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in)
+            return false;
+        m_copy.resize(size_t(in.tellg()));
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(m_copy.data()), std::streamsize(m_copy.size())))
+            return false;
+        m_data = m_copy.data();
+        m_size = m_copy.size();
+        return true;
+#endif
+    }
+
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+#if !(defined(__unix__) || defined(__APPLE__))
+    std::vector<unsigned char> m_copy;
+#endif
+};
+
+template <typename T>
+static const T* sectionData(const PackageFile& file, const PackageSection& section)
+{
+    if (section.offset % alignof(T) != 0 || section.offset > file.size() ||
+        section.count > (file.size() - section.offset) / sizeof(T))
+        return nullptr;
+    return reinterpret_cast<const T*>(file.data() + section.offset);
+}
+
+Hitable* loadScenePackage(const std::string& path, double aspect, Camera& camera, Scene& scene, Arena& arena,
+                          std::string& error)
+{
+    auto file = arena.make<PackageFile>();
+    if (!file->open(path))
+    {
+        error = "Unable to open scene " + path + ".";
+        return nullptr;
+    }
+    const std::string invalid = path + " is not a valid scene package for this build.";
+    if (file->size() < sizeof(PackageHeader))
+    {
+        error = invalid;
+        return nullptr;
+    }
+    PackageHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, PACKAGE_MAGIC, sizeof(header.magic)) != 0 || header.version != PACKAGE_VERSION ||
+        header.cameraSize != sizeof(Camera) || header.fileSize != file->size())
+    {
+        error = invalid;
+        return nullptr;
+    }
+
+    const auto* nodes = sectionData<PackedNode>(*file, header.nodes);
+    const auto* values = sectionData<double>(*file, header.values);
+    const auto* children = sectionData<uint32_t>(*file, header.children);
+    const auto* textures = sectionData<PackedTexture>(*file, header.textures);
+    const auto* materials = sectionData<PackedMaterial>(*file, header.materials);
+    const auto* pixels = sectionData<unsigned char>(*file, header.pixels);
+    if (!nodes || !values || !children || !textures || !materials || !pixels || header.root >= header.nodes.count)
+    {
+        error = invalid;
+        return nullptr;
+    }
+
+    // Everything refers only to records before it, which are made first.
+    std::vector<Texture*> texture(header.textures.count);
+    for (size_t i = 0; i < texture.size(); i++)
+    {
+        const PackedTexture& t = textures[i];
+        switch (t.type)
+        {
+        case TextureType::Constant:
+            texture[i] = arena.make<ConstantTexture>(Vector3(t.values[0], t.values[1], t.values[2]));
+            break;
+        case TextureType::Checker:
+            if (t.textures[0] >= i || t.textures[1] >= i)
+                break;
+            texture[i] = arena.make<CheckerTexture>(texture[t.textures[0]], texture[t.textures[1]]);
+            break;
+        case TextureType::Noise:
+            texture[i] = arena.make<NoiseTexture>(t.values[0]);
+            break;
+        case TextureType::Image:
+            if (t.width <= 0 || t.height <= 0 || t.pixels > header.pixels.count ||
+                ImageTexture::pyramidSize(t.width, t.height) > header.pixels.count - t.pixels)
+                break;
+            texture[i] = arena.make<ImageTexture>(pixels + t.pixels, t.width, t.height, true);
+            break;
+        case TextureType::TiledImage:
+        {
+            const auto* path = reinterpret_cast<const char*>(pixels + t.pixels);
+            if (t.pixels >= header.pixels.count || memchr(path, '\0', header.pixels.count - t.pixels) == nullptr)
+                break;
+            texture[i] = TextureCache::instance().image(path, error);
+            if (texture[i] == nullptr)
+                return nullptr;
+            break;
+        }
+        }
+        if (texture[i] == nullptr)
+        {
+            error = invalid;
+            return nullptr;
+        }
+    }
+
+    const MaterialId firstMaterial = MaterialId(scene.materials.size());
+    for (size_t i = 0; i < header.materials.count; i++)
+    {
+        const PackedMaterial& m = materials[i];
+        if (m.type != MaterialType::Metal && m.type != MaterialType::Dielectric && m.texture >= texture.size())
+        {
+            error = invalid;
+            return nullptr;
+        }
+        switch (m.type)
+        {
+        case MaterialType::Lambertian:
+            scene.materials.add(Lambertian(texture[m.texture]));
+            break;
+        case MaterialType::Metal:
+            scene.materials.add(Metal(Vector3(m.values[0], m.values[1], m.values[2]), m.values[3]));
+            break;
+        case MaterialType::Dielectric:
+            scene.materials.add(Dielectric(m.values[0]));
+            break;
+        case MaterialType::DiffuseLight:
+            scene.materials.add(DiffuseLight(texture[m.texture]));
+            break;
+        case MaterialType::Isotropic:
+            scene.materials.add(Isotropic(texture[m.texture]));
+            break;
+        default:
+            error = invalid;
+            return nullptr;
+        }
+    }
+
+    std::vector<Hitable*> object(header.nodes.count);
+    // Instances at or below each node, limited as in the scene files.
+    std::vector<int> instanceDepth(header.nodes.count);
+    std::vector<Hitable*> list;
+    for (size_t i = 0; i < object.size(); i++)
+    {
+        const PackedNode& n = nodes[i];
+        const auto type = size_t(n.type);
+        if (type >= sizeof(NODE_VALUES) / sizeof(NODE_VALUES[0]) ||
+            n.firstValue > header.values.count || NODE_VALUES[type] > header.values.count - n.firstValue ||
+            n.firstChild > header.children.count || n.numChildren > header.children.count - n.firstChild ||
+            (NODE_CHILDREN[type] >= 0 && n.numChildren != uint32_t(NODE_CHILDREN[type])) ||
+            (NODE_CHILDREN[type] < 0 && n.numChildren == 0) || (NODE_MATERIAL[type] && n.material >= header.materials.count))
+        {
+            error = invalid;
+            return nullptr;
+        }
+        const double* v = values + n.firstValue;
+        list.clear();
+        for (uint32_t c = 0; c < n.numChildren; c++)
+        {
+            if (children[n.firstChild + c] >= i)
+            {
+                error = invalid;
+                return nullptr;
+            }
+            list.push_back(object[children[n.firstChild + c]]);
+            instanceDepth[i] = std::max(instanceDepth[i], instanceDepth[children[n.firstChild + c]]);
+        }
+        if (n.type == NodeType::Translate || n.type == NodeType::RotateY)
+        {
+            if (++instanceDepth[i] > SurfaceHit::MAX_INSTANCES)
+            {
+                error = path + ": instances nested more than " + std::to_string(SurfaceHit::MAX_INSTANCES) + " deep.";
+                return nullptr;
+            }
+        }
+        const MaterialId material = firstMaterial + n.material;
+
+        switch (n.type)
+        {
+        case NodeType::Sphere:
+            object[i] = arena.make<Sphere>(Vector3(v[0], v[1], v[2]), v[3], material);
+            break;
+        case NodeType::MovingSphere:
+            object[i] = arena.make<MovingSphere>(Vector3(v[0], v[1], v[2]), Vector3(v[3], v[4], v[5]), v[6], v[7],
+                                                 v[8], material);
+            break;
+        case NodeType::XYRectangle:
+            object[i] = arena.make<XYRectangle>(v[0], v[1], v[2], v[3], v[4], material);
+            break;
+        case NodeType::XZRectangle:
+            object[i] = arena.make<XZRectangle>(v[0], v[1], v[2], v[3], v[4], material);
+            break;
+        case NodeType::YZRectangle:
+            object[i] = arena.make<YZRectangle>(v[0], v[1], v[2], v[3], v[4], material);
+            break;
+        case NodeType::Triangle:
+            object[i] = arena.make<Triangle>(Vector3(v[0], v[1], v[2]), Vector2(v[3], v[4]),
+                                             Vector3(v[5], v[6], v[7]), Vector2(v[8], v[9]),
+                                             Vector3(v[10], v[11], v[12]), Vector2(v[13], v[14]), material);
+            break;
+        case NodeType::FlipNormals:
+            object[i] = arena.make<FlipNormals>(list[0]);
+            break;
+        case NodeType::Box:
+            object[i] = arena.make<Box>(Vector3(v[0], v[1], v[2]), Vector3(v[3], v[4], v[5]), list[0]);
+            break;
+        case NodeType::Translate:
+            object[i] = arena.make<Translate>(list[0], Vector3(v[0], v[1], v[2]));
+            break;
+        case NodeType::RotateY:
+            object[i] = arena.make<RotateY>(list[0], v[0]);
+            break;
+        case NodeType::List:
+            object[i] = arena.make<HitableList>(list);
+            break;
+        case NodeType::BVH:
+            object[i] = arena.make<BVH>(list[0], list[1], AABB(Vector3(v[0], v[1], v[2]), Vector3(v[3], v[4], v[5])));
+            break;
+        case NodeType::Medium:
+            object[i] = arena.make<ConstantMedium>(list[0], v[0], material);
+            break;
+        }
+    }
+
+    memcpy(&camera, header.camera, sizeof(Camera));
+    camera.setAspect(aspect);
+    if (header.ambient == 1)
+        scene.ambient = arena.make<SkyAmbient>();
+    else
+        scene.ambient = arena.make<ConstantAmbient>(Vector3(header.ambientColor[0], header.ambientColor[1],
+                                                            header.ambientColor[2]));
+    return object[header.root];
+}
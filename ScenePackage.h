@@ -0,0 +1,162 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_SCENEPACKAGE_H
+#define PATHTRACER_SCENEPACKAGE_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Arena;
+class Camera;
+class Hitable;
+class Material;
+class Scene;
+class Texture;
+
+//
+// Compiled scene package: a built scene, BVHs and all, with its decoded
+// textures and material table, in one file that is memory-mapped to load.
+//
+// Each section is an array of fixed-size records at a 64 byte aligned offset.
+// A node is written after the nodes below it, so loading is one pass over the
+// records making an object for each in the arena: nothing is parsed, sorted
+// or decoded, and image texels, mip pyramids included, are used where they
+// lie in the mapping.  Tiled textures are referred to by path, and opened
+// through the TextureCache on loading.  A node shared by several parents (a
+// medium's boundary, a BVH leaf) is written once.
+//
+// Records hold native integers and doubles, so a package is only read by
+// builds for the architecture that wrote it.
+//
+enum class NodeType : uint32_t
+{
+    Sphere,         // center, radius
+    MovingSphere,   // center0, center1, time0, time1, radius
+    XYRectangle,    // x0, x1, y0, y1, k
+    XZRectangle,    // x0, x1, z0, z1, k
+    YZRectangle,    // y0, y1, z0, z1, k
+    Triangle,       // v0, uv0, v1, uv1, v2, uv2
+    FlipNormals,    // one child
+    Box,            // min, max; one child
+    Translate,      // offset; one child
+    RotateY,        // angle; one child
+    List,           // any number of children
+    BVH,            // bounds min, max; left and right child
+    Medium          // density; one child, the boundary
+};
+
+enum class TextureType : uint32_t
+{
+    Constant,       // color
+    Checker,        // even and odd textures
+    Noise,          // scale
+    Image,          // RGB texels of the mip pyramid
+    TiledImage      // path of a tiled texture file, see TextureCache.h
+};
+
+enum class MaterialType : uint32_t
+{
+    Lambertian,     // texture
+    Metal,          // albedo, fuzz
+    Dielectric,     // refractive index
+    DiffuseLight,   // texture
+    Isotropic       // texture
+};
+
+struct PackedNode
+{
+    NodeType type;
+    uint32_t material;
+    uint32_t firstValue;    // in the value section
+    uint32_t firstChild;    // in the child section
+    uint32_t numChildren;
+    uint32_t padding[3];
+};
+
+struct PackedTexture
+{
+    TextureType type;
+    uint32_t textures[2];
+    int32_t width, height;
+    uint32_t padding;
+    uint64_t pixels;        // offset of the pyramid, or the path, in the pixel section
+    double values[3];
+};
+
+struct PackedMaterial
+{
+    MaterialType type;
+    uint32_t texture;
+    double values[4];
+};
+
+//
+// Collects a scene into package records.  The records are made by a switch on
+// the type of each hitable, texture and material in ScenePackage.cpp, so the
+// scene classes know nothing of the package format.
+//
+class ScenePackageWriter
+{
+public:
+    // Packs the hitables below 'world' with the materials and ambient light of
+    // their scene and writes them.
+    bool write(const std::string& path, const Hitable* world, const Camera& camera, const Scene& scene,
+               std::string& error);
+
+private:
+    // Index of the node of a hitable, packing it, and the nodes below it, on
+    // first use.
+    uint32_t node(const Hitable* hitable);
+    uint32_t texture(const Texture* texture);
+
+    uint32_t packNode(const Hitable* hitable);
+    uint32_t packTexture(const Texture* texture);
+    uint32_t packMaterial(const Material& material);
+
+    uint32_t addNode(NodeType type, std::initializer_list<double> values, uint32_t material = 0,
+                     const std::vector<uint32_t>& children = {});
+    // For an image, 'pixels' are the texels of its first level and 'mips'
+    // those of the rest of its pyramid, see ImageTexture.
+    uint32_t addTexture(const PackedTexture& texture, const unsigned char* pixels = nullptr,
+                        const unsigned char* mips = nullptr);
+    // A tiled image is stored as its path and stays out of the package.
+    uint32_t addTexture(const PackedTexture& texture, const std::string& path);
+    uint32_t addMaterial(const PackedMaterial& material);
+
+    // Marks the package as unwritable.
+    uint32_t fail(const std::string& message);
+
+    std::vector<PackedNode> m_nodes;
+    std::vector<double> m_values;
+    std::vector<uint32_t> m_children;
+    std::vector<PackedTexture> m_textures;
+    std::vector<PackedMaterial> m_materials;
+    std::vector<unsigned char> m_pixels;
+
+    std::unordered_map<const Hitable*, uint32_t> m_nodeIndex;
+    std::unordered_map<const Texture*, uint32_t> m_textureIndex;
+
+    std::string m_error;
+};
+
+// Whether the file starts like a scene package.
+bool isScenePackage(const std::string& path);
+
+// Maps a package and makes its hitables in the arena, setting the camera,
+// adjusted to the aspect ratio, and the ambient light of 'scene', and adding
+// its materials to the scene's table.  nullptr with the reason in 'error' if
+// the file is not a valid package.
+Hitable* loadScenePackage(const std::string& path, double aspect, Camera& camera, Scene& scene, Arena& arena,
+                          std::string& error);
+
+#endif //PATHTRACER_SCENEPACKAGE_H
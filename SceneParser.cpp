@@ -0,0 +1,613 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include "SceneParser.h"
+#include "AmbientLight.h"
+#include "BVH.h"
+#include "HitableList.h"
+#include "Medium.h"
+#include "Rectangle.h"
+#include "Sphere.h"
+#include "TextureCache.h"
+#include "Triangle.h"
+
+SceneParser::SceneParser(std::istream& in, const std::string& name, Random& rng, Scene& scene, Arena& arena) :
+    m_in(in),
+    m_name(name),
+    m_rng(rng),
+    m_scene(scene),
+    m_arena(arena)
+{
+}
+
+Hitable* SceneParser::parse(double aspect, Camera& camera, CameraPath* cameraPath)
+{
+    m_aspect = aspect;
+    m_camera = &camera;
+    m_cameraPath = cameraPath;
+
+    std::vector<Hitable*> list;
+    for (;;)
+    {
+        if (next() == Token::End)
+            break;
+        putBack();
+        if (!parseStatement(list))
+            return nullptr;
+    }
+    if (!m_haveCamera)
+    {
+        fail("no camera");
+        return nullptr;
+    }
+    if (list.empty())
+    {
+        fail("nothing to render");
+        return nullptr;
+    }
+    return m_arena.make<HitableList>(list);
+}
+
+int SceneParser::peekChar()
+{
+    if (m_position == m_size)
+    {
+        m_in.read(m_buffer, sizeof(m_buffer));
+        m_size = size_t(m_in.gcount());
+        m_position = 0;
+        if (m_size == 0)
+            return EOF;
+    }
+    return (unsigned char)m_buffer[m_position];
+}
+
+SceneParser::Token SceneParser::next()
+{
+    if (m_putBack)
+    {
+        m_putBack = false;
+        return m_token;
+    }
+
+    int c;
+    for (;;)
+    {
+        c = peekChar();
+        if (c == '#')
+        {
+            while (c != EOF && c != '\n')
+            {
+                m_position++;
+                c = peekChar();
+            }
+        }
+        if (c == EOF || !isspace(c))
+            break;
+        if (c == '\n')
+            m_line++;
+        m_position++;
+    }
+
+    m_text.clear();
+    if (c == EOF)
+        return m_token = Token::End;
+    m_position++;
+    if (c == '{')
+        return m_token = Token::Open;
+    if (c == '}')
+        return m_token = Token::Close;
+    if (c == '"')
+    {
+        while ((c = peekChar()) != EOF && c != '"' && c != '\n')
+        {
+            m_text += char(c);
+            m_position++;
+        }
+        if (c == '"')
+            m_position++;
+        return m_token = Token::String;
+    }
+
+    m_text += char(c);
+    while ((c = peekChar()) != EOF && !isspace(c) && c != '{' && c != '}' && c != '#' && c != '"')
+    {
+        m_text += char(c);
+        m_position++;
+    }
+    return m_token = Token::Word;
+}
+
+bool SceneParser::fail(const std::string& message)
+{
+    if (m_error.empty())
+        m_error = m_name + ":" + std::to_string(m_line) + ": " + message;
+    return false;
+}
+
+bool SceneParser::expect(Token token, const char* what)
+{
+    if (next() != token)
+        return fail(std::string("expected ") + what);
+    return true;
+}
+
+bool SceneParser::parseNumber(double& value)
+{
+    if (next() != Token::Word)
+        return fail("expected a number");
+    char* end;
+    value = strtod(m_text.c_str(), &end);
+    if (*end != '\0')
+        return fail("expected a number, found '" + m_text + "'");
+    return true;
+}
+
+bool SceneParser::parseVector(Vector3& value)
+{
+    double x, y, z;
+    if (!parseNumber(x) || !parseNumber(y) || !parseNumber(z))
+        return false;
+    value = Vector3(x, y, z);
+    return true;
+}
+
+bool SceneParser::parseVector(Vector2& value)
+{
+    double x, y;
+    if (!parseNumber(x) || !parseNumber(y))
+        return false;
+    value = Vector2(x, y);
+    return true;
+}
+
+bool SceneParser::parseName(std::string& name)
+{
+    if (next() != Token::Word)
+        return fail("expected a name");
+    name = m_text;
+    return true;
+}
+
+bool SceneParser::parseTexture(Texture*& texture)
+{
+    if (next() != Token::Word)
+        return fail("expected a texture");
+
+    // A color makes a constant texture.
+    char* end;
+    strtod(m_text.c_str(), &end);
+    if (*end == '\0')
+    {
+        putBack();
+        Vector3 color;
+        if (!parseVector(color))
+            return false;
+        texture = m_arena.make<ConstantTexture>(color);
+        return true;
+    }
+
+    auto found = m_textures.find(m_text);
+    if (found == m_textures.end())
+        return fail("unknown texture '" + m_text + "'");
+    texture = found->second;
+    return true;
+}
+
+bool SceneParser::parseMaterial(MaterialId& material)
+{
+    if (next() != Token::Word)
+        return fail("expected a material");
+    auto found = m_materials.find(m_text);
+    if (found == m_materials.end())
+        return fail("unknown material '" + m_text + "'");
+    material = found->second;
+    return true;
+}
+
+bool SceneParser::parseStatement(std::vector<Hitable*>& list)
+{
+    if (next() != Token::Word)
+        return fail("expected a statement");
+    const std::string keyword = m_text;
+
+    if (keyword == "camera")
+        return parseCamera();
+    if (keyword == "ambient")
+        return parseAmbient();
+    if (keyword == "texture")
+        return parseTextureDefinition();
+    if (keyword == "material")
+        return parseMaterialDefinition();
+
+    if (keyword == "sphere")
+    {
+        Vector3 center;
+        double radius;
+        MaterialId material;
+        if (!parseVector(center) || !parseNumber(radius) || !parseMaterial(material))
+            return false;
+        list.push_back(m_arena.make<Sphere>(center, radius, material));
+        return true;
+    }
+    if (keyword == "moving_sphere")
+    {
+        Vector3 center0, center1;
+        double time0, time1, radius;
+        MaterialId material;
+        if (!parseVector(center0) || !parseVector(center1) || !parseNumber(time0) || !parseNumber(time1) ||
+            !parseNumber(radius) || !parseMaterial(material))
+            return false;
+        list.push_back(m_arena.make<MovingSphere>(center0, center1, time0, time1, radius, material));
+        return true;
+    }
+    if (keyword == "rect")
+    {
+        std::string plane;
+        double a0, a1, b0, b1, k;
+        MaterialId material;
+        if (!parseName(plane) || !parseNumber(a0) || !parseNumber(a1) || !parseNumber(b0) || !parseNumber(b1) ||
+            !parseNumber(k) || !parseMaterial(material))
+            return false;
+        if (plane == "xy")
+            list.push_back(m_arena.make<XYRectangle>(a0, a1, b0, b1, k, material));
+        else if (plane == "xz")
+            list.push_back(m_arena.make<XZRectangle>(a0, a1, b0, b1, k, material));
+        else if (plane == "yz")
+            list.push_back(m_arena.make<YZRectangle>(a0, a1, b0, b1, k, material));
+        else
+            return fail("unknown rectangle plane '" + plane + "'");
+        return true;
+    }
+    if (keyword == "box")
+    {
+        Vector3 p0, p1;
+        MaterialId material;
+        if (!parseVector(p0) || !parseVector(p1) || !parseMaterial(material))
+            return false;
+        list.push_back(m_arena.make<Box>(p0, p1, material, m_arena));
+        return true;
+    }
+    if (keyword == "triangle")
+    {
+        Vector3 p0, p1, p2;
+        Vector2 uv0, uv1, uv2;
+        MaterialId material;
+        if (!parseVector(p0) || !parseVector(uv0) || !parseVector(p1) || !parseVector(uv1) ||
+            !parseVector(p2) || !parseVector(uv2) || !parseMaterial(material))
+            return false;
+        list.push_back(m_arena.make<Triangle>(p0, uv0, p1, uv1, p2, uv2, material));
+        return true;
+    }
+
+    if (keyword == "list")
+    {
+        std::vector<Hitable*> children;
+        if (!parseBlock(children))
+            return false;
+        list.push_back(m_arena.make<HitableList>(children));
+        return true;
+    }
+    if (keyword == "bvh")
+    {
+        std::vector<Hitable*> children;
+        if (!parseBlock(children))
+            return false;
+        list.push_back(m_arena.make<BVH>(children, 0, 1, m_rng, m_arena));
+        return true;
+    }
+    if (keyword == "flip")
+    {
+        Hitable* child;
+        if (!parseBlock(child))
+            return false;
+        list.push_back(m_arena.make<FlipNormals>(child));
+        return true;
+    }
+    if (keyword == "translate")
+    {
+        Vector3 offset;
+        Track<Vector3>* offsets;
+        Hitable* child;
+        if (!parseKeys(offset, offsets, [this](Vector3& value) { return parseVector(value); }) ||
+            !parseInstanceBlock(child))
+            return false;
+        auto translate = m_arena.make<Translate>(child, offset);
+        translate->animate(offsets);
+        list.push_back(translate);
+        return true;
+    }
+    if (keyword == "rotate_y")
+    {
+        double angle;
+        Track<double>* angles;
+        Hitable* child;
+        if (!parseKeys(angle, angles, [this](double& value) { return parseNumber(value); }) ||
+            !parseInstanceBlock(child))
+            return false;
+        auto rotate = m_arena.make<RotateY>(child, angle);
+        rotate->animate(angles);
+        list.push_back(rotate);
+        return true;
+    }
+    if (keyword == "medium")
+    {
+        double density;
+        Texture* albedo;
+        Hitable* boundary;
+        if (!parseNumber(density) || !parseTexture(albedo) || !parseBlock(boundary))
+            return false;
+        list.push_back(m_arena.make<ConstantMedium>(boundary, density, m_scene.materials.add(Isotropic(albedo))));
+        return true;
+    }
+
+    return fail("unknown statement '" + keyword + "'");
+}
+
+bool SceneParser::parseCamera()
+{
+    CameraKey settings{Vector3(0, 0, 0), Vector3(0, 0, -1), Vector3(0, 1, 0), 40, 0, -1};
+    double time0 = 0, time1 = 1;
+    std::vector<std::pair<double, CameraKey>> keys;
+
+    if (!expect(Token::Open, "'{'"))
+        return false;
+    while (next() != Token::Close)
+    {
+        if (m_token != Token::Word)
+            return fail("expected a camera setting or '}'");
+        const std::string setting = m_text;
+        CameraKey& key = keys.empty() ? settings : keys.back().second;
+        bool ok;
+        if (setting == "from")
+            ok = parseVector(key.from);
+        else if (setting == "at")
+            ok = parseVector(key.at);
+        else if (setting == "up")
+            ok = parseVector(key.up);
+        else if (setting == "fov")
+            ok = parseNumber(key.fov);
+        else if (setting == "aperture")
+            ok = parseNumber(key.aperture);
+        else if (setting == "focus")
+            ok = parseNumber(key.focus);
+        else if (setting == "time")
+            ok = parseNumber(time0) && parseNumber(time1);
+        else if (setting == "key")
+        {
+            double frame;
+            if (!parseNumber(frame))
+                return false;
+            if (!keys.empty() && frame <= keys.back().first)
+                return fail("camera keys out of frame order");
+            const CameraKey previous = key;
+            keys.emplace_back(frame, previous);
+            ok = true;
+        }
+        else
+            return fail("unknown camera setting '" + setting + "'");
+        if (!ok)
+            return false;
+    }
+    if (keys.empty())
+        keys.emplace_back(0, settings);
+
+    for (auto& key : keys)
+    {
+        // Focused on the point looked at unless told otherwise.
+        if (key.second.focus <= 0)
+            key.second.focus = (key.second.at - key.second.from).length();
+    }
+    const CameraKey& first = keys.front().second;
+    *m_camera = Camera(first.from, first.at, first.up, first.fov, m_aspect, first.aperture, first.focus, time0, time1);
+    if (m_cameraPath != nullptr && keys.size() > 1)
+    {
+        for (const auto& key : keys)
+            m_cameraPath->keys.add(key.first, key.second);
+        m_cameraPath->time0 = time0;
+        m_cameraPath->time1 = time1;
+    }
+    m_haveCamera = true;
+    return true;
+}
+
+bool SceneParser::parseAmbient()
+{
+    if (next() == Token::Word && m_text == "sky")
+    {
+        m_scene.ambient = m_arena.make<SkyAmbient>();
+        return true;
+    }
+    putBack();
+    Vector3 color;
+    if (!parseVector(color))
+        return false;
+    m_scene.ambient = m_arena.make<ConstantAmbient>(color);
+    return true;
+}
+
+bool SceneParser::parseTextureDefinition()
+{
+    std::string name, type;
+    if (!parseName(name) || !parseName(type))
+        return false;
+    if (m_textures.count(name))
+        return fail("texture '" + name + "' defined twice");
+
+    Texture* texture;
+    if (type == "constant")
+    {
+        Vector3 color;
+        if (!parseVector(color))
+            return false;
+        texture = m_arena.make<ConstantTexture>(color);
+    }
+    else if (type == "checker")
+    {
+        Texture* even;
+        Texture* odd;
+        if (!parseTexture(even) || !parseTexture(odd))
+            return false;
+        texture = m_arena.make<CheckerTexture>(even, odd);
+    }
+    else if (type == "noise")
+    {
+        double scale;
+        if (!parseNumber(scale))
+            return false;
+        texture = m_arena.make<NoiseTexture>(scale);
+    }
+    else if (type == "image")
+    {
+        if (next() != Token::String && m_token != Token::Word)
+            return fail("expected an image file");
+        std::string path = m_text;
+        const size_t slash = m_name.find_last_of('/');
+        if (!path.empty() && path[0] != '/' && slash != std::string::npos)
+            path = m_name.substr(0, slash + 1) + path;
+        std::string error;
+        texture = TextureCache::instance().image(path, error);
+        if (texture == nullptr)
+            return fail(error);
+    }
+    else
+    {
+        return fail("unknown texture type '" + type + "'");
+    }
+    m_textures[name] = texture;
+    return true;
+}
+
+bool SceneParser::parseMaterialDefinition()
+{
+    std::string name, type;
+    if (!parseName(name) || !parseName(type))
+        return false;
+    if (m_materials.count(name))
+        return fail("material '" + name + "' defined twice");
+
+    MaterialId material;
+    if (type == "lambertian" || type == "diffuse_light" || type == "isotropic")
+    {
+        Texture* texture;
+        if (!parseTexture(texture))
+            return false;
+        if (type == "lambertian")
+            material = m_scene.materials.add(Lambertian(texture));
+        else if (type == "diffuse_light")
+            material = m_scene.materials.add(DiffuseLight(texture));
+        else
+            material = m_scene.materials.add(Isotropic(texture));
+    }
+    else if (type == "metal")
+    {
+        Vector3 albedo;
+        double fuzz;
+        if (!parseVector(albedo) || !parseNumber(fuzz))
+            return false;
+        material = m_scene.materials.add(Metal(albedo, fuzz));
+    }
+    else if (type == "dielectric")
+    {
+        double index;
+        if (!parseNumber(index))
+            return false;
+        material = m_scene.materials.add(Dielectric(index));
+    }
+    else
+    {
+        return fail("unknown material type '" + type + "'");
+    }
+    m_materials[name] = material;
+    return true;
+}
+
+bool SceneParser::parseBlock(std::vector<Hitable*>& list)
+{
+    if (!expect(Token::Open, "'{'"))
+        return false;
+    while (next() != Token::Close)
+    {
+        if (m_token == Token::End)
+            return fail("expected '}'");
+        putBack();
+        if (!parseStatement(list))
+            return false;
+    }
+    if (list.empty())
+        return fail("empty block");
+    return true;
+}
+
+// A value, or keys of it over frames: 'key <frame> <value>' repeated.  The
+// value is then the first key's; 'track' is null when there are no keys.
+template <typename T, typename ParseValue>
+bool SceneParser::parseKeys(T& value, Track<T>*& track, ParseValue parseValue)
+{
+    track = nullptr;
+    if (next() != Token::Word || m_text != "key")
+    {
+        putBack();
+        return parseValue(value);
+    }
+    track = m_arena.make<Track<T>>();
+    do
+    {
+        double frame;
+        T key{};
+        if (!parseNumber(frame) || !parseValue(key))
+            return false;
+        if (!track->empty() && frame <= track->lastFrame())
+            return fail("keys out of frame order");
+        if (track->empty())
+            value = key;
+        track->add(frame, key);
+    } while (next() == Token::Word && m_text == "key");
+    putBack();
+    return true;
+}
+
+bool SceneParser::parseBlock(Hitable*& hitable)
+{
+    std::vector<Hitable*> children;
+    if (!parseBlock(children))
+        return false;
+    hitable = (children.size() == 1) ? children.front() : m_arena.make<HitableList>(children);
+    return true;
+}
+
+// The block of a translate or rotate_y.  A hit records the instances above
+// it, see SurfaceHit, so their nesting is limited.
+bool SceneParser::parseInstanceBlock(Hitable*& hitable)
+{
+    if (m_instanceDepth >= SurfaceHit::MAX_INSTANCES)
+        return fail("translate and rotate_y nested more than " + std::to_string(SurfaceHit::MAX_INSTANCES) + " deep");
+    m_instanceDepth++;
+    const bool parsed = parseBlock(hitable);
+    m_instanceDepth--;
+    return parsed;
+}
+
+Hitable* loadScene(const std::string& path, double aspect, Camera& camera, Random& rng, Scene& scene,
+                   Arena& arena, std::string& error, CameraPath* cameraPath)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        error = "Unable to open scene " + path + ".";
+        return nullptr;
+    }
+    SceneParser parser(in, path, rng, scene, arena);
+    Hitable* world = parser.parse(aspect, camera, cameraPath);
+    if (world == nullptr)
+        error = parser.error();
+    return world;
+}
@@ -0,0 +1,158 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_SCENEPARSER_H
+#define PATHTRACER_SCENEPARSER_H
+
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Arena.h"
+#include "Camera.h"
+#include "Hitable.h"
+#include "Material.h"
+#include "Random.h"
+#include "Scene.h"
+#include "Texture.h"
+
+//
+// Reads a text scene description, building the scene into the arena, and its
+// materials and ambient light into the Scene, as the file is read.  The file is a sequence of statements, each a keyword and its
+// arguments, separated by any whitespace; '#' starts a comment.
+//
+//   camera { from 278 278 -800  at 278 278 0  up 0 1 0  fov 40
+//            aperture 0  focus 10  time 0 1 }
+//   camera { fov 40  key 0 from 0 0 -800 at 0 0 0  key 48 from 800 0 0 ... }
+//   ambient sky | ambient <r g b>
+//
+//   texture <name> constant <r g b>
+//   texture <name> checker <texture> <texture>
+//   texture <name> noise <scale>
+//   texture <name> image "<file>"
+//
+//   material <name> lambertian <texture>
+//   material <name> metal <r g b> <fuzz>
+//   material <name> dielectric <index>
+//   material <name> diffuse_light <texture>
+//   material <name> isotropic <texture>
+//
+//   sphere <center> <radius> <material>
+//   moving_sphere <center0> <center1> <time0> <time1> <radius> <material>
+//   rect xy|xz|yz <a0> <a1> <b0> <b1> <k> <material>
+//   box <min> <max> <material>
+//   triangle <p0> <uv0> <p1> <uv1> <p2> <uv2> <material>
+//
+//   list { ... }
+//   bvh { ... }
+//   flip { ... }
+//   translate <offset> { ... }
+//   translate key <frame> <offset> key <frame> <offset> ... { ... }
+//   rotate_y <degrees> { ... }
+//   rotate_y key <frame> <degrees> key <frame> <degrees> ... { ... }
+//   medium <density> <texture> { <boundary> }
+//
+// translate and rotate_y nest at most SurfaceHit::MAX_INSTANCES deep,
+// counting through any blocks between them.
+//
+// A <texture> argument is the name of a texture or a color, which makes a
+// constant texture.  Textures and materials must be defined before they are
+// used.  Anything with a diffuse_light material is a light.  Image paths are
+// relative to the scene file; an image is either a tiled texture, see
+// TextureCache.h, or any file stb_image reads, and is opened once however
+// many textures name it.
+//
+// Keys animate the camera and transforms over frames, see Animation.h; they
+// are given in increasing frame order.  A camera key starts as a copy of the
+// one before it, or of the settings before the first key, and changes the
+// settings that follow it.
+//
+class SceneParser
+{
+public:
+    // 'name' is used in error messages and to find images.
+    SceneParser(std::istream& in, const std::string& name, Random& rng, Scene& scene, Arena& arena);
+
+    // The whole scene, with the camera set from the file, or nullptr with the
+    // reason in error().  A keyed camera is set to its first key, and its keys
+    // go to 'cameraPath' if given.
+    Hitable* parse(double aspect, Camera& camera, CameraPath* cameraPath = nullptr);
+
+    const std::string& error() const { return m_error; }
+
+private:
+    enum class Token
+    {
+        End,
+        Word,
+        String,
+        Open,
+        Close
+    };
+
+    int peekChar();
+    Token next();
+    void putBack() { m_putBack = true; }
+
+    bool fail(const std::string& message);
+    bool expect(Token token, const char* what);
+    bool parseNumber(double& value);
+    bool parseVector(Vector3& value);
+    bool parseVector(Vector2& value);
+    bool parseName(std::string& name);
+    bool parseTexture(Texture*& texture);
+    bool parseMaterial(MaterialId& material);
+    template <typename T, typename ParseValue>
+    bool parseKeys(T& value, Track<T>*& track, ParseValue parseValue);
+
+    bool parseStatement(std::vector<Hitable*>& list);
+    bool parseCamera();
+    bool parseAmbient();
+    bool parseTextureDefinition();
+    bool parseMaterialDefinition();
+    bool parseBlock(std::vector<Hitable*>& list);
+    bool parseBlock(Hitable*& hitable);
+    bool parseInstanceBlock(Hitable*& hitable);
+
+    std::istream& m_in;
+    std::string m_name;
+    Random& m_rng;
+    Scene& m_scene;
+    Arena& m_arena;
+
+    // Current token; the text of a word or string.
+    Token m_token = Token::End;
+    std::string m_text;
+    bool m_putBack = false;
+    int m_line = 1;
+
+    char m_buffer[1 << 16];
+    size_t m_position = 0;
+    size_t m_size = 0;
+
+    double m_aspect = 1;
+    Camera* m_camera = nullptr;
+    CameraPath* m_cameraPath = nullptr;
+    bool m_haveCamera = false;
+
+    // translate and rotate_y blocks the parser is inside.
+    int m_instanceDepth = 0;
+
+    std::unordered_map<std::string, Texture*> m_textures;
+    std::unordered_map<std::string, MaterialId> m_materials;
+
+    std::string m_error;
+};
+
+// Reads the scene file at 'path', see SceneParser; nullptr with the reason in
+// 'error' if it cannot be read.
+Hitable* loadScene(const std::string& path, double aspect, Camera& camera, Random& rng, Scene& scene,
+                   Arena& arena, std::string& error, CameraPath* cameraPath = nullptr);
+
+#endif //PATHTRACER_SCENEPARSER_H
@@ -12,6 +12,7 @@
 #include "AABB.h"
 #include "ONB.h"
 #include "PDF.h"
+#include "Material.h"
 
 void Sphere::get_uv(const Vector3& p, Vector2& uv) const
 {
@@ -21,7 +22,7 @@ void Sphere::get_uv(const Vector3& p, Vector2& uv) const
     uv.v() = (theta + M_PI/2) / M_PI;
 }
 
-bool Sphere::hit(const Ray& r, double tmin, double tmax, HitRecord& rec) const
+bool Sphere::intersect(const Ray& r, double tmin, double tmax, SurfaceHit& hit) const
 {
     Vector3 oc = r.origin() - center;
     double a = dot(r.direction(), r.direction());
@@ -33,27 +34,32 @@ bool Sphere::hit(const Ray& r, double tmin, double tmax, HitRecord& rec) const
         double temp = (-b - sqrt(discriminant)) / a;
         if (temp < tmax && temp > tmin)
         {
-            rec.t = temp;
-            rec.p = r.pointAt(rec.t);
-            rec.normal = (rec.p - center) / radius;
-            rec.material = material;
-            get_uv(rec.normal, rec.uv);
+            hit.set(this, temp);
             return true;
         }
         temp = (-b + sqrt(discriminant)) / a;
         if (temp < tmax && temp > tmin)
         {
-            rec.t = temp;
-            rec.p = r.pointAt(rec.t);
-            rec.normal = (rec.p - center) / radius;
-            rec.material = material;
-            get_uv(rec.normal, rec.uv);
+            hit.set(this, temp);
             return true;
         }
     }
     return false;
 }
 
+void Sphere::surface(const Ray& r, const SurfaceHit& hit, HitRecord& rec) const
+{
+    rec.t = hit.t;
+    rec.p = r.pointAt(rec.t);
+    rec.normal = (rec.p - center) / radius;
+    rec.material = material;
+    get_uv(rec.normal, rec.uv);
+    // Along the parallel, 2 pi r cos(latitude) long, and the meridian, pi r.
+    const double absRadius = std::fabs(radius);
+    const double cosLatitude = std::max(sqrt(std::max(0.0, 1 - rec.normal.y() * rec.normal.y())), 1e-6);
+    rec.uvDensity = Vector2(1 / (2 * M_PI * absRadius * cosLatitude), 1 / (M_PI * absRadius));
+}
+
 bool Sphere::bounds(double t0, double t1, AABB &bbox) const
 {
     bbox = AABB(center - Vector3(radius, radius, radius), center + Vector3(radius, radius, radius));
@@ -62,8 +68,8 @@ bool Sphere::bounds(double t0, double t1, AABB &bbox) const
 
 double Sphere::pdfValue(const Vector3& o, const Vector3& v) const
 {
-   HitRecord rec;
-    if (hit(Ray(o, v), 0.001, DBL_MAX, rec)) {
+    SurfaceHit hit;
+    if (intersect(Ray(o, v), 0.001, DBL_MAX, hit)) {
         double cosThetaMax = sqrt(1 - radius * radius / (center - o).squared_length());
         double solidAngle = 2 * M_PI * (1 - cosThetaMax);
         return 1 / solidAngle;
@@ -71,13 +77,18 @@ double Sphere::pdfValue(const Vector3& o, const Vector3& v) const
     return 0;
 }
 
-Vector3 Sphere::random(const Vector3& o) const
+Vector3 Sphere::random(const Vector3& o, Sampler& sampler) const
 {
     Vector3 direction = center - o;
     double distSqrd = direction.squared_length();
     ONB uvw;
     uvw.buildFromW(direction);
-    return uvw.local(randomToUnitSphere(radius, distSqrd));
+    return uvw.local(randomToUnitSphere(radius, distSqrd, sampler));
+}
+
+Vector3 Sphere::power(const MaterialTable& materials) const
+{
+    return surfacePower(materials, material, area());
 }
 
 Vector3 MovingSphere::center(double time) const
@@ -85,7 +96,7 @@ Vector3 MovingSphere::center(double time) const
     return center0 + ((time - time0) / (time1 - time0)) * (center1 - center0);
 }
 
-bool MovingSphere::hit(const Ray &ray, double t_min, double t_max, HitRecord &rec) const
+bool MovingSphere::intersect(const Ray &ray, double t_min, double t_max, SurfaceHit &hit) const
 {
     Vector3 oc = ray.origin() - center(ray.time());
     double a = dot(ray.direction(), ray.direction());
@@ -97,27 +108,28 @@ bool MovingSphere::hit(const Ray &ray, double t_min, double t_max, HitRecord &re
         double temp = (-b - sqrt(discriminant)) / a;
         if (temp < t_max && temp > t_min)
         {
-            rec.t = temp;
-            rec.p = ray.pointAt(rec.t);
-            rec.normal = (rec.p - center(ray.time())) / radius;
-            rec.material = material;
-            get_uv(rec.p, rec.uv);
+            hit.set(this, temp);
             return true;
         }
         temp = (-b + sqrt(discriminant)) / a;
         if (temp < t_max && temp > t_min)
         {
-            rec.t = temp;
-            rec.p = ray.pointAt(rec.t);
-            rec.normal = (rec.p - center(ray.time())) / radius;
-            rec.material = material;
-            get_uv(rec.p, rec.uv);
+            hit.set(this, temp);
             return true;
         }
     }
     return false;
 }
 
+void MovingSphere::surface(const Ray &ray, const SurfaceHit &hit, HitRecord &rec) const
+{
+    rec.t = hit.t;
+    rec.p = ray.pointAt(rec.t);
+    rec.normal = (rec.p - center(ray.time())) / radius;
+    rec.material = material;
+    get_uv(rec.p, rec.uv);
+}
+
 bool MovingSphere::bounds(double t0, double t1, AABB &bbox) const
 {
     AABB box0 = AABB(center0 - Vector3(radius, radius, radius), center0 + Vector3(radius, radius, radius));
@@ -126,6 +138,11 @@ bool MovingSphere::bounds(double t0, double t1, AABB &bbox) const
     return true;
 }
 
+Vector3 MovingSphere::power(const MaterialTable& materials) const
+{
+    return surfacePower(materials, material, area());
+}
+
 void MovingSphere::get_uv(const Vector3& p, Vector2& uv) const
 {
     double phi = atan2(p.z(), p.x());
@@ -134,7 +151,7 @@ void MovingSphere::get_uv(const Vector3& p, Vector2& uv) const
     uv.v() = (theta + M_PI/2) / M_PI;
 }
 
-bool Cone::hit(const Ray &r, double tmin, double tmax, HitRecord &rec) const
+bool Cone::intersect(const Ray &r, double tmin, double tmax, SurfaceHit &hit) const
 {
     double k = radius / height;
     k = k * k;
@@ -155,22 +172,13 @@ bool Cone::hit(const Ray &r, double tmin, double tmax, HitRecord &rec) const
         double temp = (-b - sqrt(discriminant)) / a;
         if (temp < tmax && temp > tmin)
         {
-            rec.t = temp;
-            rec.p = r.pointAt(rec.t);
-            // TODO: compute correct normal and uv
-            rec.normal = (rec.p - center) / radius;
-            rec.material = material;
-            get_uv(rec.p, rec.uv);
+            hit.set(this, temp);
             return true;
         }
         temp = (-b + sqrt(discriminant)) / a;
         if (temp < tmax && temp > tmin)
         {
-            rec.t = temp;
-            rec.p = r.pointAt(rec.t);
-            rec.normal = (rec.p - center) / radius;
-            rec.material = material;
-            get_uv(rec.p, rec.uv);
+            hit.set(this, temp);
             return true;
         }
     }
@@ -178,6 +186,16 @@ bool Cone::hit(const Ray &r, double tmin, double tmax, HitRecord &rec) const
     return false;
 }
 
+void Cone::surface(const Ray &r, const SurfaceHit &hit, HitRecord &rec) const
+{
+    rec.t = hit.t;
+    rec.p = r.pointAt(rec.t);
+    // TODO: compute correct normal and uv
+    rec.normal = (rec.p - center) / radius;
+    rec.material = material;
+    get_uv(rec.p, rec.uv);
+}
+
 bool Cone::bounds(double t0, double t1, AABB &bbox) const
 {
     return false;
@@ -188,9 +206,9 @@ double Cone::pdfValue(const Vector3 &o, const Vector3 &v) const
     return Hitable::pdfValue(o, v);
 }
 
-Vector3 Cone::random(const Vector3 &o) const
+Vector3 Cone::random(const Vector3 &o, Sampler& sampler) const
 {
-    return Hitable::random(o);
+    return Hitable::random(o, sampler);
 }
 
 void Cone::get_uv(const Vector3& p, Vector2& uv) const
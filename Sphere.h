@@ -17,25 +17,34 @@ class Sphere : public Hitable
 public:
     Sphere() = default;
 
-    Sphere(const Vector3& cen, double r, Material* m) :
+    Sphere(const Vector3& cen, double r, MaterialId m) :
         center(cen),
         radius(r),
         material(m) { }
 
-    bool hit(const Ray& r, double tmin, double tmax, HitRecord& rec) const override;
+    bool intersect(const Ray& r, double tmin, double tmax, SurfaceHit& hit) const override;
+
+    void surface(const Ray& r, const SurfaceHit& hit, HitRecord& rec) const override;
 
     bool bounds(double t0, double t1, AABB& bbox) const override;
 
     double pdfValue(const Vector3& o, const Vector3& v) const override;
 
-    Vector3 random(const Vector3& o) const override;
+    Vector3 random(const Vector3& o, Sampler& sampler) const override;
+
+    double area() const override
+    { return 4 * M_PI * radius * radius; }
+
+    Vector3 power(const MaterialTable& materials) const override;
 
     void get_uv(const Vector3& p, Vector2& uv) const;
 
 private:
+    friend class ScenePackageWriter;
+
     Vector3 center{};
     double radius = 0;
-    Material* material = nullptr;
+    MaterialId material{};
 
 };
 
@@ -44,7 +53,7 @@ class MovingSphere : public Hitable
 public:
     MovingSphere() = default;
 
-    MovingSphere(const Vector3& cen0, const Vector3& cen1, double t0, double t1, double r, Material* mtl) :
+    MovingSphere(const Vector3& cen0, const Vector3& cen1, double t0, double t1, double r, MaterialId mtl) :
         center0(cen0),
         center1(cen1),
         time0(t0),
@@ -53,19 +62,28 @@ public:
         material(mtl)
     {}
 
-    bool hit(const Ray& ray, double t_min, double t_max, HitRecord& rec) const override;
+    bool intersect(const Ray& ray, double t_min, double t_max, SurfaceHit& hit) const override;
+
+    void surface(const Ray& ray, const SurfaceHit& hit, HitRecord& rec) const override;
 
     bool bounds(double t0, double t1, AABB& bbox) const override;
 
     Vector3 center(double time) const;
 
+    double area() const override
+    { return 4 * M_PI * radius * radius; }
+
+    Vector3 power(const MaterialTable& materials) const override;
+
     void get_uv(const Vector3& p, Vector2& uv) const;
 
 private:
+    friend class ScenePackageWriter;
+
     Vector3 center0{}, center1{};
     double time0 = 0, time1 = 0;
     double radius = 0;
-    Material* material = nullptr;
+    MaterialId material{};
 };
 
 class Cone : public Hitable
@@ -73,26 +91,28 @@ class Cone : public Hitable
 public:
     Cone() = default;
 
-    Cone(const Vector3& cen, double r, double h, Material* m) :
+    Cone(const Vector3& cen, double r, double h, MaterialId m) :
         center(cen),
         radius(r),
         height(h),
         material(m) { }
 
-    bool hit(const Ray& r, double tmin, double tmax, HitRecord& rec) const override;
+    bool intersect(const Ray& r, double tmin, double tmax, SurfaceHit& hit) const override;
+
+    void surface(const Ray& r, const SurfaceHit& hit, HitRecord& rec) const override;
 
     bool bounds(double t0, double t1, AABB& bbox) const override;
 
     double pdfValue(const Vector3& o, const Vector3& v) const override;
 
-    Vector3 random(const Vector3& o) const override;
+    Vector3 random(const Vector3& o, Sampler& sampler) const override;
 
     void get_uv(const Vector3& p, Vector2& uv) const;
 
 private:
     Vector3 center{};
     double radius = 0, height = 0;
-    Material* material = nullptr;
+    MaterialId material{};
 };
 
 #endif //PATHTRACER_SPHERE_H
@@ -7,18 +7,176 @@
  * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
  */
 
+#include <cstdint>
 #include "Texture.h"
+#include "TextureCache.h"
 
-Vector3 ImageTexture::value(const Vector2& uv, const Vector3 &p) const
-{
-    int i = uv.u() * nx;
-    int j = (1 - uv.v()) * ny - 0.001;
-    i = std::max(0, i);
-    j = std::max(0, j);
-    i = std::min(i, nx-1);
-    j = std::min(j, ny-1);
-    double r = int(data[3*i + 3*nx*j + 0]) / 255.0;
-    double g = int(data[3*i + 3*nx*j + 1]) / 255.0;
-    double b = int(data[3*i + 3*nx*j + 2]) / 255.0;
-    return {r, g, b};
-}
\ No newline at end of file
+static int nextLevelSize(int size)
+{
+    return std::max(1, size / 2);
+}
+
+size_t ImageTexture::pyramidSize(int Nx, int Ny)
+{
+    size_t size = 0;
+    for (;;)
+    {
+        size += size_t(Nx) * size_t(Ny) * 3;
+        if (Nx == 1 && Ny == 1)
+            return size;
+        Nx = nextLevelSize(Nx);
+        Ny = nextLevelSize(Ny);
+    }
+}
+
+ImageTexture::ImageTexture(const unsigned char *pixels, int Nx, int Ny, bool pyramid) :
+    data(pixels),
+    nx(Nx),
+    ny(Ny)
+{
+    if (!pyramid)
+        mipTexels.resize(pyramidSize(nx, ny) - size_t(nx) * ny * 3);
+
+    levels.push_back({data, nx, ny});
+    unsigned char* next = pyramid ? nullptr : mipTexels.data();
+    while (levels.back().width > 1 || levels.back().height > 1)
+    {
+        const Level src = levels.back();
+        const size_t srcSize = size_t(src.width) * src.height * 3;
+        Level dst{src.texels + srcSize, nextLevelSize(src.width), nextLevelSize(src.height)};
+        if (!pyramid)
+        {
+            // Each texel the average of the 2x2 below it, the last row or
+            // column of an odd sized level taken twice.
+            for (int y = 0; y < dst.height; y++)
+            {
+                const int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+                for (int x = 0; x < dst.width; x++)
+                {
+                    const int x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+                    for (int c = 0; c < 3; c++)
+                    {
+                        const int sum = src.texels[3 * (y0 * src.width + x0) + c] +
+                                        src.texels[3 * (y0 * src.width + x1) + c] +
+                                        src.texels[3 * (y1 * src.width + x0) + c] +
+                                        src.texels[3 * (y1 * src.width + x1) + c];
+                        next[3 * (y * dst.width + x) + c] = (unsigned char)((sum + 2) / 4);
+                    }
+                }
+            }
+            dst.texels = next;
+            next += size_t(dst.width) * dst.height * 3;
+        }
+        levels.push_back(dst);
+    }
+}
+
+ImageTexture::ImageTexture(const TiledImage* image) :
+    nx(image->width()),
+    ny(image->height()),
+    tiled(image)
+{
+    for (const auto& level : image->levels())
+        levels.push_back({nullptr, level.width, level.height});
+}
+
+// Texels of a pyramid in memory.
+struct MemoryFetch
+{
+    const std::vector<ImageTexture::Level>& levels;
+
+    const unsigned char* operator()(size_t level, int x, int y) const
+    {
+        return levels[level].texels + 3 * (size_t(y) * levels[level].width + x);
+    }
+};
+
+// Texels of a tiled image, read through the cache.  A texel is only valid
+// until the next is fetched.
+struct TileFetch
+{
+    const TiledImage& image;
+    size_t level = SIZE_MAX;
+    int tx = -1, ty = -1;
+    const TextureTile* tile = nullptr;
+
+    const unsigned char* operator()(size_t l, int x, int y)
+    {
+        const int tileX = x / TiledImage::TILE_SIZE, tileY = y / TiledImage::TILE_SIZE;
+        if (l != level || tileX != tx || tileY != ty)
+        {
+            tile = TextureCache::instance().tile(image, int(l), tileX, tileY);
+            level = l;
+            tx = tileX;
+            ty = tileY;
+        }
+        const int ix = x - tileX * TiledImage::TILE_SIZE, iy = y - tileY * TiledImage::TILE_SIZE;
+        return tile->texels + 3 * (iy * TiledImage::TILE_SIZE + ix);
+    }
+};
+
+// Texel centers are at half integers; rows run down the image, v up it.
+// Lookups outside the image are clamped to its edge.
+template <typename Fetch>
+Vector3 ImageTexture::bilinear(Fetch& fetch, size_t level, const Vector2& uv) const
+{
+    const int width = levels[level].width, height = levels[level].height;
+    const double x = uv.u() * width - 0.5;
+    const double y = (1 - uv.v()) * height - 0.5;
+    const double fx = std::floor(x), fy = std::floor(y);
+    const double sx = x - fx, sy = y - fy;
+    const int x0 = std::min(std::max(int(fx), 0), width - 1);
+    const int y0 = std::min(std::max(int(fy), 0), height - 1);
+    const int x1 = std::min(std::max(int(fx) + 1, 0), width - 1);
+    const int y1 = std::min(std::max(int(fy) + 1, 0), height - 1);
+
+    // Copied out, see TileFetch.
+    unsigned char t[4][3];
+    const int xs[4] = {x0, x1, x0, x1}, ys[4] = {y0, y0, y1, y1};
+    for (int i = 0; i < 4; i++)
+    {
+        const unsigned char* texel = fetch(level, xs[i], ys[i]);
+        t[i][0] = texel[0];
+        t[i][1] = texel[1];
+        t[i][2] = texel[2];
+    }
+    double rgb[3];
+    for (int c = 0; c < 3; c++)
+    {
+        const double top = (1 - sx) * t[0][c] + sx * t[1][c];
+        const double bottom = (1 - sx) * t[2][c] + sx * t[3][c];
+        rgb[c] = ((1 - sy) * top + sy * bottom) / 255.0;
+    }
+    return {rgb[0], rgb[1], rgb[2]};
+}
+
+template <typename Fetch>
+Vector3 ImageTexture::filter(Fetch& fetch, const Vector2& uv, const Vector2& footprint) const
+{
+    // Level of detail: log2 of the footprint's size in texels of the first
+    // level, by its longer side.
+    const double texels = std::max(footprint.u() * nx, footprint.v() * ny);
+    if (!(texels > 1))
+        return bilinear(fetch, 0, uv);
+    const double lod = std::log2(texels);
+    const auto last = levels.size() - 1;
+    if (lod >= double(last))
+        return bilinear(fetch, last, uv);
+    const auto level = size_t(lod);
+    const double s = lod - double(level);
+    return (1 - s) * bilinear(fetch, level, uv) + s * bilinear(fetch, level + 1, uv);
+}
+
+Vector3 ImageTexture::value(const Vector2& uv, const Vector3 &p, const Vector2& footprint) const
+{
+    if (levels.empty())
+        return {0, 0, 0};
+
+    if (tiled != nullptr)
+    {
+        TileFetch fetch{*tiled};
+        return filter(fetch, uv, footprint);
+    }
+    MemoryFetch fetch{levels};
+    return filter(fetch, uv, footprint);
+}
@@ -11,14 +11,19 @@
 #define PATHTRACER_TEXTURE_H
 
 #include <cassert>
+#include <vector>
 #include "Perlin.h"
 #include "Noise.h"
 #include "Vector2.h"
 
+class TiledImage;
+
 class Texture
 {
 public:
-    virtual Vector3 value(const Vector2& uv, const Vector3 &p) const = 0;
+    // 'footprint' is the extent in u and v of the area the lookup stands
+    // for, see HitRecord::setFootprint; zero for a point.
+    virtual Vector3 value(const Vector2& uv, const Vector3 &p, const Vector2& footprint) const = 0;
 };
 
 class ConstantTexture : public Texture
@@ -30,12 +35,14 @@ public:
         color(c)
     {}
 
-    Vector3 value(const Vector2& uv, const Vector3 &p) const override
+    Vector3 value(const Vector2& uv, const Vector3 &p, const Vector2& footprint) const override
     {
         return color;
     }
 
 private:
+    friend class ScenePackageWriter;
+
     Vector3 color{};
 };
 
@@ -49,16 +56,18 @@ public:
         even(t0)
     {}
 
-    Vector3 value(const Vector2& uv, const Vector3 &p) const override
+    Vector3 value(const Vector2& uv, const Vector3 &p, const Vector2& footprint) const override
     {
         double sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
         if (sines < 0)
-            return odd->value(uv, p);
+            return odd->value(uv, p, footprint);
         else
-            return even->value(uv, p);
+            return even->value(uv, p, footprint);
     }
 
 private:
+    friend class ScenePackageWriter;
+
     Texture *odd = nullptr;
     Texture *even = nullptr;
 };
@@ -70,7 +79,7 @@ public:
         scale(sc)
     {}
 
-    Vector3 value(const Vector2& uv, const Vector3 &p) const override
+    Vector3 value(const Vector2& uv, const Vector3 &p, const Vector2& footprint) const override
     {
         //double n = (Noise(p) + 1) / 2;
         //double n = Turbulence(scale * p);
@@ -81,27 +90,59 @@ public:
     }
 
 private:
+    friend class ScenePackageWriter;
+
     double scale = 1.0;
     Perlin perlin;
 };
 
+//
+// RGB image with a mip pyramid: each level a 2x2 box filtered copy of the one
+// before at half the size, down to 1x1.  Lookups are bilinear, and blend the
+// two levels whose texels are nearest the footprint in size (trilinear).
+//
+// The pyramid is either in memory or in a tiled texture file, whose texels
+// are read through the TextureCache.
+//
 class ImageTexture : public Texture
 {
 public:
+    struct Level
+    {
+        const unsigned char* texels;    // nullptr for a tiled image
+        int width, height;
+    };
+
     ImageTexture()
     = default;
 
-    ImageTexture(const unsigned char *pixels, int Nx, int Ny) :
-        data(pixels),
-        nx(Nx),
-        ny(Ny)
-    {}
+    // 'pixels' are the rows of the image from the top, and outlive the
+    // texture.  The smaller levels are made from them, unless 'pyramid' says
+    // they follow in the same buffer, laid out as in a scene package.
+    ImageTexture(const unsigned char *pixels, int Nx, int Ny, bool pyramid = false);
+
+    explicit ImageTexture(const TiledImage* image);
+
+    Vector3 value(const Vector2& uv, const Vector3 &p, const Vector2& footprint) const override;
 
-    Vector3 value(const Vector2& uv, const Vector3 &p) const override;
+    const std::vector<Level>& pyramid() const { return levels; }
+
+    // Bytes of the whole pyramid of an image, level after level.
+    static size_t pyramidSize(int Nx, int Ny);
 
 private:
+    friend class ScenePackageWriter;
+
+    template <typename Fetch>
+    Vector3 bilinear(Fetch& fetch, size_t level, const Vector2& uv) const;
+    template <typename Fetch>
+    Vector3 filter(Fetch& fetch, const Vector2& uv, const Vector2& footprint) const;
+
     const unsigned char *data{};
     int nx = 0, ny= 0;
+    std::vector<Level> levels;
+    std::vector<unsigned char> mipTexels;   // of the levels after the first, unless given
+    const TiledImage* tiled{};
 };
 
 #endif //PATHTRACER_TEXTURE_H
@@ -0,0 +1,414 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "TextureCache.h"
+#include "Texture.h"
+#include "stb_image.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char TILED_MAGIC[8] = {'P', 'T', 'T', 'I', 'L', 'E', 'S', '\0'};
+static const uint32_t TILED_VERSION = 1;
+
+struct TiledHeader
+{
+    char magic[8];
+    uint32_t version;
+    int32_t width, height;
+    int32_t tileSize;
+    uint32_t levels;
+    uint32_t padding[9];    // to 64 bytes, where the first tile starts
+};
+
+static_assert(sizeof(TiledHeader) == 64, "TiledHeader must be 64 bytes");
+
+// The levels of an image's pyramid in the file, the same levels as
+// ImageTexture makes.
+static std::vector<TiledImage::Level> tiledLevels(int width, int height)
+{
+    std::vector<TiledImage::Level> levels;
+    uint64_t offset = sizeof(TiledHeader);
+    for (;;)
+    {
+        TiledImage::Level level{width, height, (width + TiledImage::TILE_SIZE - 1) / TiledImage::TILE_SIZE,
+                                (height + TiledImage::TILE_SIZE - 1) / TiledImage::TILE_SIZE, offset};
+        levels.push_back(level);
+        offset += uint64_t(level.tilesX) * level.tilesY * TiledImage::TILE_BYTES;
+        if (width == 1 && height == 1)
+            return levels;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+}
+
+TiledImage::~TiledImage()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if (m_file >= 0)
+        close(m_file);
+#endif
+}
+
+bool TiledImage::open(const std::string& path, uint32_t id, std::string& error)
+{
+    m_path = path;
+    m_id = id;
+    const std::string invalid = path + " is not a valid tiled texture for this build.";
+
+    TiledHeader header{};
+    uint64_t fileSize;
+#if defined(__unix__) || defined(__APPLE__)
+    m_file = ::open(path.c_str(), O_RDONLY);
+    struct stat info{};
+    if (m_file < 0 || fstat(m_file, &info) != 0)
+    {
+        error = "Unable to open texture " + path + ".";
+        return false;
+    }
+    fileSize = uint64_t(info.st_size);
+    if (pread(m_file, &header, sizeof(header), 0) != ssize_t(sizeof(header)))
+    {
+        error = invalid;
+        return false;
+    }
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+    {
+        error = "Unable to open texture " + path + ".";
+        return false;
+    }
+    fileSize = uint64_t(in.tellg());
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    {
+        error = invalid;
+        return false;
+    }
+#endif
+
+    // Tile coordinates are 16 bits in the cache keys.
+    const int maxSize = TILE_SIZE << 16;
+    if (memcmp(header.magic, TILED_MAGIC, sizeof(header.magic)) != 0 || header.version != TILED_VERSION ||
+        header.tileSize != TILE_SIZE || header.width <= 0 || header.height <= 0 || header.width > maxSize ||
+        header.height > maxSize)
+    {
+        error = invalid;
+        return false;
+    }
+    m_levels = tiledLevels(header.width, header.height);
+    const Level& last = m_levels.back();
+    if (header.levels != m_levels.size() || fileSize != last.offset + TILE_BYTES)
+    {
+        error = invalid;
+        return false;
+    }
+    return true;
+}
+
+bool TiledImage::readTile(int level, int tx, int ty, unsigned char* texels) const
+{
+    const Level& l = m_levels[level];
+    const uint64_t offset = l.offset + (uint64_t(ty) * l.tilesX + tx) * TILE_BYTES;
+#if defined(__unix__) || defined(__APPLE__)
+    size_t done = 0;
+    while (done < TILE_BYTES)
+    {
+        const ssize_t n = pread(m_file, texels + done, TILE_BYTES - done, off_t(offset + done));
+        if (n <= 0)
+            return false;
+        done += size_t(n);
+    }
+    return true;
+#else
+    std::lock_guard<std::mutex> lock(m_readMutex);
+    std::ifstream in(m_path, std::ios::binary);
+    in.seekg(std::streamoff(offset));
+    return bool(in.read(reinterpret_cast<char*>(texels), std::streamsize(TILE_BYTES)));
+#endif
+}
+
+bool TiledImage::isTiledImage(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(TILED_MAGIC)];
+    return in.read(magic, sizeof(magic)) && memcmp(magic, TILED_MAGIC, sizeof(magic)) == 0;
+}
+
+bool TiledImage::write(const std::string& path, const unsigned char* pixels, int width, int height,
+                       std::string& error)
+{
+    const ImageTexture image(pixels, width, height);
+    const std::vector<ImageTexture::Level>& pyramid = image.pyramid();
+    const std::vector<Level> levels = tiledLevels(width, height);
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        error = "Unable to write " + path + ".";
+        return false;
+    }
+    TiledHeader header{};
+    memcpy(header.magic, TILED_MAGIC, sizeof(header.magic));
+    header.version = TILED_VERSION;
+    header.width = width;
+    header.height = height;
+    header.tileSize = TILE_SIZE;
+    header.levels = uint32_t(levels.size());
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<unsigned char> tile(TILE_BYTES);
+    for (size_t l = 0; l < levels.size(); l++)
+    {
+        const ImageTexture::Level& src = pyramid[l];
+        for (int ty = 0; ty < levels[l].tilesY; ty++)
+        {
+            for (int tx = 0; tx < levels[l].tilesX; tx++)
+            {
+                // The padding past the edge of the level is never read.
+                std::fill(tile.begin(), tile.end(), 0);
+                const int x0 = tx * TILE_SIZE, y0 = ty * TILE_SIZE;
+                const int columns = std::min(TILE_SIZE, src.width - x0);
+                for (int y = 0; y < TILE_SIZE && y0 + y < src.height; y++)
+                    memcpy(&tile[size_t(y) * TILE_SIZE * 3], src.texels + 3 * (size_t(y0 + y) * src.width + x0),
+                           size_t(columns) * 3);
+                out.write(reinterpret_cast<const char*>(tile.data()), std::streamsize(tile.size()));
+            }
+        }
+    }
+    if (!out)
+    {
+        error = "Unable to write " + path + ".";
+        return false;
+    }
+    return true;
+}
+
+TextureCache::TextureCache() :
+    m_capacity(size_t(256) << 20u)
+{
+}
+
+TextureCache::~TextureCache() = default;
+
+TextureCache& TextureCache::instance()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+void TextureCache::setCapacity(size_t bytes)
+{
+    m_capacity = bytes;
+    for (auto& s : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        m_tiles -= trim(s);
+    }
+}
+
+Texture* TextureCache::image(const std::string& path, std::string& error)
+{
+    std::lock_guard<std::mutex> lock(m_imageMutex);
+    auto found = m_images.find(path);
+    if (found != m_images.end())
+    {
+        m_sharedImages++;
+        return found->second.texture.get();
+    }
+
+    Image image;
+    if (TiledImage::isTiledImage(path))
+    {
+        image.tiled.reset(new TiledImage);
+        if (!image.tiled->open(path, m_nextId, error))
+            return nullptr;
+        m_nextId++;
+        image.texture.reset(new ImageTexture(image.tiled.get()));
+    }
+    else
+    {
+        int nx, ny, nz;
+        image.pixels = {stbi_load(path.c_str(), &nx, &ny, &nz, 3), stbi_image_free};
+        if (image.pixels == nullptr)
+        {
+            error = "Unable to read image '" + path + "'.";
+            return nullptr;
+        }
+        image.texture.reset(new ImageTexture(image.pixels.get(), nx, ny));
+        m_residentBytes += ImageTexture::pyramidSize(nx, ny);
+    }
+    Texture* texture = image.texture.get();
+    m_images.emplace(path, std::move(image));
+    return texture;
+}
+
+TextureCache::Shard& TextureCache::shard(uint64_t key)
+{
+    return m_shards[(key * 0x9E3779B97F4A7C15ull) >> 60u];
+}
+
+// Drops the least recently used tiles while the shard holds more than its
+// share of the capacity, and returns how many.  With the shard locked.
+size_t TextureCache::trim(Shard& s)
+{
+    const size_t limit = std::max(size_t(1), m_capacity / TiledImage::TILE_BYTES / NUM_SHARDS);
+    size_t evicted = 0;
+    while (s.lru.size() > limit)
+    {
+        s.index.erase(s.lru.back().key);
+        s.lru.pop_back();
+        evicted++;
+    }
+    s.evictions += evicted;
+    return evicted;
+}
+
+// The tiles a thread used last, direct mapped by key.  Keys are never reused,
+// as image ids are not, so a tile here is never mistaken for another.  The
+// counters are shared with the cache, which may outlive the thread or be
+// outlived by it.
+struct TextureCache::ThreadTiles
+{
+    static constexpr int SIZE = 32;
+
+    ThreadTiles()
+    {
+        std::fill(keys, keys + SIZE, ~uint64_t(0));
+    }
+
+    // The top 5 bits of the hashed key.
+    static size_t slot(uint64_t key)
+    {
+        return size_t((key * 0x9E3779B97F4A7C15ull) >> 59u);
+    }
+
+    uint64_t keys[SIZE];
+    std::shared_ptr<const TextureTile> tiles[SIZE];
+    std::shared_ptr<ThreadCounters> counters;
+};
+
+TextureCache::ThreadTiles& TextureCache::threadTiles()
+{
+    static thread_local ThreadTiles tiles;
+    if (!tiles.counters)
+    {
+        tiles.counters = std::make_shared<ThreadCounters>();
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        m_threadCounters.push_back(tiles.counters);
+    }
+    return tiles;
+}
+
+const TextureTile* TextureCache::tile(const TiledImage& image, int level, int tx, int ty)
+{
+    const uint64_t key = (uint64_t(image.id()) << 40u) | (uint64_t(level) << 32u) | (uint64_t(ty) << 16u) |
+                         uint64_t(tx);
+    ThreadTiles& local = threadTiles();
+    const size_t slot = ThreadTiles::slot(key);
+    if (local.keys[slot] == key)
+    {
+        std::atomic<uint64_t>& hits = local.counters->hits;
+        hits.store(hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    else
+    {
+        local.tiles[slot] = load(image, level, tx, ty, key);
+        local.keys[slot] = key;
+    }
+    return local.tiles[slot].get();
+}
+
+std::shared_ptr<const TextureTile> TextureCache::load(const TiledImage& image, int level, int tx, int ty,
+                                                      uint64_t key)
+{
+    Shard& s = shard(key);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto found = s.index.find(key);
+        if (found != s.index.end())
+        {
+            s.lru.splice(s.lru.begin(), s.lru, found->second);
+            s.hits++;
+            return found->second->tile;
+        }
+    }
+
+    auto tile = std::make_shared<TextureTile>();
+    const bool read = image.readTile(level, tx, ty, tile->texels);
+    if (!read)
+        memset(tile->texels, 0, sizeof(tile->texels));
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (!read)
+        s.readErrors++;
+    auto found = s.index.find(key);
+    if (found != s.index.end())
+    {
+        // Another thread read it meanwhile.
+        s.lru.splice(s.lru.begin(), s.lru, found->second);
+        s.hits++;
+        return found->second->tile;
+    }
+    s.misses++;
+    s.lru.push_front({key, tile});
+    s.index[key] = s.lru.begin();
+    // One update for the insertion and the evictions it caused, so the count
+    // never shows a shard over its share.
+    const size_t change = 1 - trim(s);
+    const size_t tiles = m_tiles.fetch_add(change) + change;
+    size_t peak = m_peakTiles.load();
+    while (tiles > peak && !m_peakTiles.compare_exchange_weak(peak, tiles))
+        ;
+    return tile;
+}
+
+TextureCache::Statistics TextureCache::statistics() const
+{
+    Statistics stats;
+    for (auto& s : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        stats.hits += s.hits;
+        stats.misses += s.misses;
+        stats.evictions += s.evictions;
+        stats.readErrors += s.readErrors;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        for (const auto& counters : m_threadCounters)
+            stats.hits += counters->hits.load(std::memory_order_relaxed);
+    }
+    stats.peakBytes = m_peakTiles.load() * TiledImage::TILE_BYTES;
+    std::lock_guard<std::mutex> lock(m_imageMutex);
+    stats.images = m_images.size();
+    stats.sharedImages = m_sharedImages;
+    stats.residentBytes = m_residentBytes;
+    return stats;
+}
+
+void TextureCache::clear()
+{
+    for (auto& s : m_shards)
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        m_tiles -= s.lru.size();
+        s.index.clear();
+        s.lru.clear();
+    }
+    std::lock_guard<std::mutex> lock(m_imageMutex);
+    m_images.clear();
+    m_residentBytes = 0;
+}
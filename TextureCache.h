@@ -0,0 +1,205 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_TEXTURECACHE_H
+#define PATHTRACER_TEXTURECACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ImageTexture;
+class Texture;
+
+//
+// Tiled texture file: a header, then the mip pyramid of the image (see
+// ImageTexture) level by level, each level a grid of TILE_SIZE x TILE_SIZE
+// RGB tiles in rows from the top.  Tiles at the right and bottom edges are
+// padded to full size, so any tile is found, and read, without an index.
+//
+// Like scene packages, the header holds native integers, so a file is only
+// read by builds for the architecture that wrote it.
+//
+class TiledImage
+{
+public:
+    static constexpr int TILE_SIZE = 64;
+    static constexpr size_t TILE_BYTES = size_t(TILE_SIZE) * TILE_SIZE * 3;
+
+    struct Level
+    {
+        int width, height;
+        int tilesX, tilesY;
+        uint64_t offset;        // of its first tile in the file
+    };
+
+    TiledImage() = default;
+    ~TiledImage();
+
+    TiledImage(const TiledImage&) = delete;
+    TiledImage& operator=(const TiledImage&) = delete;
+
+    // Opens the file and checks its header against its size.  The tiles are
+    // read as needed, see TextureCache::tile().
+    bool open(const std::string& path, uint32_t id, std::string& error);
+
+    // Reads a tile into 'texels', TILE_BYTES of them.  Safe to call from any
+    // number of threads at once.
+    bool readTile(int level, int tx, int ty, unsigned char* texels) const;
+
+    const std::string& path() const { return m_path; }
+    uint32_t id() const { return m_id; }
+    int width() const { return m_levels.front().width; }
+    int height() const { return m_levels.front().height; }
+    const std::vector<Level>& levels() const { return m_levels; }
+
+    // Whether the file starts like a tiled texture.
+    static bool isTiledImage(const std::string& path);
+
+    // Writes the image, 'pixels' its rows from the top, as a tiled texture.
+    static bool write(const std::string& path, const unsigned char* pixels, int width, int height,
+                      std::string& error);
+
+private:
+    std::string m_path;
+    uint32_t m_id = 0;
+    std::vector<Level> m_levels;
+    int m_file = -1;
+#if !(defined(__unix__) || defined(__APPLE__))
+    mutable std::mutex m_readMutex;
+#endif
+};
+
+struct TextureTile
+{
+    unsigned char texels[TiledImage::TILE_BYTES];
+};
+
+//
+// The images the textures of a scene read, opened once per path, and a
+// fixed-size cache of the tiles of the tiled ones.
+//
+// Tiles are loaded when a lookup first needs them and evicted least recently
+// used first, so the memory held for tiled textures stays within the capacity
+// however much texture the scene references.
+//
+// The tiles are spread over shards by key, each with its own lock and LRU
+// list, so the render threads rarely wait for each other.  A miss reads the
+// tile without the lock held.  In front of the shards each thread keeps the
+// last 32 tiles it used, which answer most lookups without a lock, as the
+// lookups of a path vertex, and of the vertices traced after it, mostly land
+// in the same tiles.  Those are held on top of the capacity, evicted or not,
+// until the thread moves on from them.
+//
+class TextureCache
+{
+public:
+    struct Statistics
+    {
+        uint64_t hits = 0;          // by a thread's own tiles or the shards
+        uint64_t misses = 0;        // tiles read
+        uint64_t evictions = 0;
+        uint64_t readErrors = 0;
+        size_t peakBytes = 0;       // of tiles held at once
+        size_t images = 0;          // opened, one per path
+        size_t sharedImages = 0;    // requests answered with an image already open
+        size_t residentBytes = 0;   // of the images loaded whole, pyramids included
+    };
+
+    TextureCache();
+    ~TextureCache();
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    // The cache shared by every scene.
+    static TextureCache& instance();
+
+    // Bytes of tiles held at most.  Set before rendering.
+    void setCapacity(size_t bytes);
+    size_t capacity() const { return m_capacity; }
+
+    // The texture of the image at 'path', opened on the first request for the
+    // path and shared by every later one.  A tiled texture is read a tile at a
+    // time through the cache; any other image stb_image reads is decoded
+    // whole.  nullptr, with the reason in 'error', if it cannot be read.
+    // Safe to call from any thread.
+    Texture* image(const std::string& path, std::string& error);
+
+    // The tile of a tiled image at tile column tx and row ty of a level,
+    // valid until the calling thread looks up another.  A tile that cannot be
+    // read is black.
+    const TextureTile* tile(const TiledImage& image, int level, int tx, int ty);
+
+    Statistics statistics() const;
+
+    // Forgets every image and tile, at scene teardown, after the materials.
+    void clear();
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        std::shared_ptr<const TextureTile> tile;
+    };
+
+    struct alignas(64) Shard
+    {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;       // most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t readErrors = 0;
+    };
+
+    // Written by one thread, read by statistics().
+    struct alignas(64) ThreadCounters
+    {
+        std::atomic<uint64_t> hits{0};
+    };
+
+    struct ThreadTiles;
+
+    struct Image
+    {
+        std::unique_ptr<TiledImage> tiled;
+        std::unique_ptr<ImageTexture> texture;
+        std::unique_ptr<unsigned char, void (*)(void*)> pixels{nullptr, nullptr};
+    };
+
+    static constexpr int NUM_SHARDS = 16;
+
+    ThreadTiles& threadTiles();
+    Shard& shard(uint64_t key);
+    std::shared_ptr<const TextureTile> load(const TiledImage& image, int level, int tx, int ty, uint64_t key);
+    size_t trim(Shard& shard);
+
+    mutable std::mutex m_imageMutex;
+    std::unordered_map<std::string, Image> m_images;
+    uint32_t m_nextId = 0;
+    size_t m_sharedImages = 0;
+    size_t m_residentBytes = 0;
+
+    mutable std::mutex m_threadMutex;
+    std::vector<std::shared_ptr<ThreadCounters>> m_threadCounters;
+
+    Shard m_shards[NUM_SHARDS];
+    size_t m_capacity;
+    std::atomic<size_t> m_tiles{0};
+    std::atomic<size_t> m_peakTiles{0};
+};
+
+#endif //PATHTRACER_TEXTURECACHE_H
@@ -0,0 +1,255 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <algorithm>
+#include <iostream>
+#include "ThreadPool.h"
+#include "Numa.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static thread_local int s_threadIndex = 0;
+static thread_local int s_threadNode = 0;
+static std::unique_ptr<ThreadPool> s_instance;
+
+// The CPUs the process may run on, as it started: the pool pins threads
+// within them, so a render under taskset or a cpuset stays inside its mask.
+// Read on first use, before any pool has pinned the main thread.
+static const std::vector<int>& allowedCpus()
+{
+    static const std::vector<int> cpus = []()
+    {
+        std::vector<int> list;
+#ifdef __linux__
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &mask))
+                    list.push_back(cpu);
+            }
+        }
+#endif
+        if (list.empty())
+        {
+            const int numCpus = std::max(1, int(std::thread::hardware_concurrency()));
+            for (int cpu = 0; cpu < numCpus; cpu++)
+                list.push_back(cpu);
+        }
+        return list;
+    }();
+    return cpus;
+}
+
+static void pinToCpu(std::thread::native_handle_type thread, int cpu)
+{
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (pthread_setaffinity_np(thread, sizeof(cpus), &cpus) != 0)
+        std::cerr << "Unable to pin thread to CPU " << cpu << "." << std::endl;
+#else
+    (void)thread;
+    (void)cpu;
+#endif
+}
+
+ThreadPool::ThreadPool(int numThreads, Affinity affinity) :
+    m_affinity(affinity)
+{
+    const std::vector<int>& cpus = allowedCpus();
+    if (numThreads <= 0)
+        numThreads = int(cpus.size());
+
+    for (int i = 0; i < numThreads; i++)
+        m_queues.emplace_back(new Queue());
+
+    s_threadIndex = 0;
+    s_threadNode = 0;
+#ifdef __linux__
+    if (m_affinity == Affinity::Cpu)
+        pinToCpu(pthread_self(), cpus[0]);
+#endif
+    if (m_affinity == Affinity::Node)
+        Numa::bindThread(0);
+    for (int i = 1; i < numThreads; i++)
+    {
+        m_threads.emplace_back(&ThreadPool::workerMain, this, i);
+        if (m_affinity == Affinity::Cpu)
+            pinToCpu(m_threads.back().native_handle(), cpus[size_t(i) % cpus.size()]);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void ThreadPool::run(TaskGroup& group, std::function<void()> task)
+{
+    group.m_pending.fetch_add(1);
+
+    const int index = std::min(s_threadIndex, numThreads() - 1);
+    {
+        Queue& queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Task{std::move(task), &group});
+    }
+    m_queued.fetch_add(1);
+
+    if (!m_threads.empty())
+    {
+        // Taking the lock orders this against a worker that has just found
+        // nothing to do and is about to sleep.
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wake.notify_one();
+    }
+}
+
+void ThreadPool::wait(TaskGroup& group)
+{
+    const int index = std::min(s_threadIndex, numThreads() - 1);
+    Task task;
+    while (group.m_pending.load() > 0)
+    {
+        if (findTask(index, task))
+        {
+            execute(task);
+            continue;
+        }
+
+        // Nothing to help with: sleep until the group's last task finishes,
+        // see execute(), or a new task is queued.
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this, &group]() { return group.m_pending.load() == 0 || m_queued.load() > 0; });
+    }
+}
+
+void ThreadPool::parallelFor(int begin, int end, const std::function<void(int)>& body, int grain)
+{
+    grain = std::max(1, grain);
+    TaskGroup group;
+    for (int start = begin; start < end; start += grain)
+    {
+        const int stop = std::min(end, start + grain);
+        run(group, [&body, start, stop]()
+        {
+            for (int i = start; i < stop; i++)
+                body(i);
+        });
+    }
+    wait(group);
+}
+
+int ThreadPool::threadIndex()
+{
+    return s_threadIndex;
+}
+
+int ThreadPool::threadNode()
+{
+    return s_threadNode;
+}
+
+void ThreadPool::configure(int numThreads, Affinity affinity)
+{
+    s_instance.reset();
+    s_instance.reset(new ThreadPool(numThreads, affinity));
+}
+
+ThreadPool& ThreadPool::instance()
+{
+    if (!s_instance)
+        s_instance.reset(new ThreadPool(0));
+    return *s_instance;
+}
+
+void ThreadPool::workerMain(int index)
+{
+    s_threadIndex = index;
+    if (m_affinity == Affinity::Node)
+    {
+        s_threadNode = Numa::threadNode(index, numThreads());
+        Numa::bindThread(s_threadNode);
+    }
+    Task task;
+    for (;;)
+    {
+        if (findTask(index, task))
+        {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this]() { return m_stop || m_queued.load() > 0; });
+        if (m_stop)
+            return;
+    }
+}
+
+bool ThreadPool::findTask(int index, Task& task)
+{
+    if (m_queued.load() == 0)
+        return false;
+
+    // Newest task of our own first, it is the most likely to be in cache...
+    {
+        Queue& queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            m_queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // ...otherwise the oldest task of another thread, the largest piece of
+    // work when tasks split recursively.
+    const int count = numThreads();
+    for (int i = 1; i < count; i++)
+    {
+        Queue& queue = *m_queues[(index + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            m_queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(Task& task)
+{
+    task.function();
+    task.function = nullptr;
+    if (task.group->m_pending.fetch_sub(1) == 1)
+    {
+        // Wakes the threads waiting on the group, under the lock so that the
+        // wakeup cannot fall between a waiter's check and its sleep.
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wake.notify_all();
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_THREADPOOL_H
+#define PATHTRACER_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Work-stealing thread pool.
+//
+// Every thread has its own task deque.  A thread pushes and pops tasks at the
+// back of its own deque, so nested work (BVH subtrees) stays on the thread
+// that created it, and an idle thread steals from the front of the others.
+// The thread that created the pool is thread 0 and runs tasks while it waits
+// on a group, so a pool of one thread runs everything inline.
+//
+class ThreadPool
+{
+public:
+    // Tasks that can be waited on together.
+    class TaskGroup
+    {
+    public:
+        TaskGroup() = default;
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+    private:
+        friend class ThreadPool;
+        std::atomic<int> m_pending{0};
+    };
+
+    enum class Affinity
+    {
+        None,
+        Cpu,    // each thread bound to one of the CPUs the process may run on
+        Node    // threads split in blocks over the NUMA nodes, see Numa.h
+    };
+
+    // numThreads <= 0 uses every CPU the process may run on.
+    explicit ThreadPool(int numThreads, Affinity affinity = Affinity::None);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int numThreads() const { return int(m_queues.size()); }
+
+    // Queue a task on the calling thread's deque.
+    void run(TaskGroup& group, std::function<void()> task);
+
+    // Returns once every task of the group has finished, running queued
+    // tasks, the group's or any other, in the meantime.
+    void wait(TaskGroup& group);
+
+    // Calls body(i) for every i in [begin, end), in chunks of 'grain'.
+    void parallelFor(int begin, int end, const std::function<void(int)>& body, int grain = 1);
+
+    // Index of the calling thread in [0, numThreads()).  Threads outside the
+    // pool report 0.
+    static int threadIndex();
+
+    // NUMA node the calling thread is bound to; 0 unless the affinity is Node.
+    static int threadNode();
+
+    // The pool shared by scene construction, rendering and image output.
+    // configure() replaces it and must not be called while it is busy.
+    static void configure(int numThreads, Affinity affinity);
+    static ThreadPool& instance();
+
+private:
+    struct Task
+    {
+        std::function<void()> function;
+        TaskGroup* group;
+    };
+
+    struct alignas(64) Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerMain(int index);
+    bool findTask(int index, Task& task);
+    void execute(Task& task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<int> m_queued{0};
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    Affinity m_affinity;
+};
+
+#endif //PATHTRACER_THREADPOOL_H
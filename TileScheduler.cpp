@@ -0,0 +1,117 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "TileScheduler.h"
+
+// Distance of (x, y) along the Hilbert curve filling an n x n grid, n a power
+// of two.
+static uint64_t hilbertIndex(uint32_t n, uint32_t x, uint32_t y)
+{
+    uint64_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2)
+    {
+        const uint32_t rx = (x & s) ? 1 : 0;
+        const uint32_t ry = (y & s) ? 1 : 0;
+        d += uint64_t(s) * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so the curve stays continuous.
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+TileScheduler::TileScheduler(int width, int height, int tileSize, Order order, int numBands)
+{
+    const int tilesX = (width + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+    numBands = std::max(1, std::min(numBands, tilesY));
+
+    struct Entry
+    {
+        int band;
+        double key;
+        Tile tile;
+    };
+    std::vector<Entry> entries;
+    entries.reserve(size_t(tilesX) * tilesY);
+
+    uint32_t gridSize = 1;
+    while (gridSize < uint32_t(std::max(tilesX, tilesY)))
+        gridSize *= 2;
+
+    for (int ty = 0; ty < tilesY; ty++)
+    {
+        for (int tx = 0; tx < tilesX; tx++)
+        {
+            Tile tile{tx * tileSize, ty * tileSize,
+                      std::min(width, (tx + 1) * tileSize), std::min(height, (ty + 1) * tileSize)};
+
+            double key = ty * tilesX + tx;
+            if (order == Order::Hilbert)
+            {
+                key = double(hilbertIndex(gridSize, uint32_t(tx), uint32_t(ty)));
+            }
+            else if (order == Order::Spiral)
+            {
+                // Rings of increasing distance from the centre, each walked
+                // around by angle.
+                const double dx = tx + 0.5 - 0.5 * tilesX;
+                const double dy = ty + 0.5 - 0.5 * tilesY;
+                const double ring = std::floor(std::max(std::fabs(dx), std::fabs(dy)));
+                key = ring + 0.5 * (std::atan2(dy, dx) + M_PI) / (2 * M_PI);
+            }
+            entries.push_back({ty * numBands / tilesY, key, tile});
+        }
+    }
+
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const Entry& a, const Entry& b) { return a.band < b.band || (a.band == b.band && a.key < b.key); });
+
+    m_tiles.reserve(entries.size());
+    for (int b = 0; b < numBands; b++)
+    {
+        m_bands.emplace_back(new Band());
+        m_bands.back()->firstRow = height;
+    }
+    for (const auto& entry : entries)
+    {
+        Band& band = *m_bands[entry.band];
+        if (band.begin == band.end)
+            band.begin = band.end = m_tiles.size();
+        band.end++;
+        band.firstRow = std::min(band.firstRow, entry.tile.y0);
+        band.lastRow = std::max(band.lastRow, entry.tile.y1);
+        m_tiles.push_back(entry.tile);
+    }
+    reset();
+}
+
+bool TileScheduler::parseOrder(const std::string& name, Order& order)
+{
+    if (name == "scanline")
+        order = Order::Scanline;
+    else if (name == "hilbert")
+        order = Order::Hilbert;
+    else if (name == "spiral")
+        order = Order::Spiral;
+    else
+        return false;
+    return true;
+}
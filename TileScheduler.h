@@ -0,0 +1,92 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_TILESCHEDULER_H
+#define PATHTRACER_TILESCHEDULER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Tile
+{
+    int x0, y0;     // inclusive
+    int x1, y1;     // exclusive
+};
+
+//
+// Hands out the tiles of an image, one at a time, to any number of render
+// threads.  Each thread takes the next tile from a shared atomic counter when
+// it finishes its last one, so threads stuck on expensive tiles (glass,
+// media) no longer leave the others idle at the end of a pass.
+//
+class TileScheduler
+{
+public:
+    enum class Order
+    {
+        Scanline,
+        Hilbert,    // neighbouring tiles are rendered close together in time
+        Spiral      // from the centre of the image outwards
+    };
+
+    // With more than one band the image is split into horizontal bands of
+    // whole tile rows, each handed out in the given order on its own, so
+    // the threads of one NUMA node can keep to the rows stored on it.
+    TileScheduler(int width, int height, int tileSize, Order order, int numBands = 1);
+
+    // Start handing out the tiles again from the first one.
+    void reset()
+    {
+        for (auto& band : m_bands)
+            band->next = band->begin;
+    }
+
+    // Claim the next tile of 'band', or of the following bands once it is
+    // used up.  Returns false once every tile has been taken.
+    bool next(Tile& tile, int band = 0)
+    {
+        for (size_t i = 0; i < m_bands.size(); i++)
+        {
+            Band& b = *m_bands[(band + i) % m_bands.size()];
+            const size_t index = b.next.fetch_add(1, std::memory_order_relaxed);
+            if (index < b.end)
+            {
+                tile = m_tiles[index];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t numTiles() const { return m_tiles.size(); }
+
+    int numBands() const { return int(m_bands.size()); }
+
+    // Image rows [firstRow, lastRow) of a band.
+    int bandFirstRow(int band) const { return m_bands[band]->firstRow; }
+    int bandLastRow(int band) const { return m_bands[band]->lastRow; }
+
+    // Parses "scanline", "hilbert" or "spiral".  Returns false for anything else.
+    static bool parseOrder(const std::string& name, Order& order);
+
+private:
+    struct alignas(64) Band
+    {
+        std::atomic<size_t> next{0};
+        size_t begin = 0, end = 0;  // range of m_tiles
+        int firstRow = 0, lastRow = 0;
+    };
+
+    std::vector<Tile> m_tiles;
+    std::vector<std::unique_ptr<Band>> m_bands;
+};
+
+#endif //PATHTRACER_TILESCHEDULER_H
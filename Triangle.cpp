@@ -8,11 +8,13 @@
  */
 
 #include "Triangle.h"
+#include "Material.h"
+#include "Sampler.h"
 
 Triangle::Triangle(const Vector3& v0, const Vector2& t0,
          const Vector3& v1, const Vector2& t1,
          const Vector3& v2, const Vector2& t2,
-         Material* mtl) :
+         MaterialId mtl) :
     v0(v0),
     v1(v1),
     v2(v2),
@@ -22,9 +24,10 @@ Triangle::Triangle(const Vector3& v0, const Vector2& t0,
     material(mtl)
     {
         calcBounds();
+        surfaceArea = 0.5 * cross(v1 - v0, v2 - v0).length();
     }
 
-bool Triangle::hit(const Ray &ray, double t_min, double t_max, HitRecord &rec) const
+bool Triangle::intersect(const Ray &ray, double t_min, double t_max, SurfaceHit &hit) const
 {
     //
     // Tomas Moller and Ben Trumbore, "Fast Minimum Storage Ray-Triangle Intersection,"
@@ -68,16 +71,41 @@ bool Triangle::hit(const Ray &ray, double t_min, double t_max, HitRecord &rec) c
     u *= inv_det;
     v *= inv_det;
 
-    rec.t = t;
+    hit.set(this, t, u, v);
+    return true;
+}
+
+void Triangle::surface(const Ray &ray, const SurfaceHit &hit, HitRecord &rec) const
+{
+    // u was computed in single precision.
+    const auto u = float(hit.u);
+    const double v = hit.v;
+
+    rec.t = hit.t;
     rec.p = (1 - u - v) * v0 + u * v1 + v * v2;
-    rec.normal = cross(edge1, edge2);
+    rec.normal = cross(v1 - v0, v2 - v0);
     rec.normal.make_unit_vector();
     rec.material = material;
 
     Vector3 bary(1.0 - u - v, u, v);
     calcTexCoord(bary, rec.uv);
 
-    return true;
+    // The lengths of the gradients of u and v over the plane of the
+    // triangle, each a combination a e1 + b e2 of its edges.
+    const Vector3 e1 = v1 - v0;
+    const Vector3 e2 = v2 - v0;
+    const double e11 = dot(e1, e1), e12 = dot(e1, e2), e22 = dot(e2, e2);
+    const double det = e11 * e22 - e12 * e12;
+    if (det > 0)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            const double d1 = t1[k] - t0[k], d2 = t2[k] - t0[k];
+            const double a = (d1 * e22 - d2 * e12) / det;
+            const double b = (d2 * e11 - d1 * e12) / det;
+            rec.uvDensity[k] = sqrt(std::max(0.0, a * a * e11 + 2 * a * b * e12 + b * b * e22));
+        }
+    }
 }
 
 bool Triangle::bounds(double t0, double t1, AABB &bbox) const
@@ -86,12 +114,50 @@ bool Triangle::bounds(double t0, double t1, AABB &bbox) const
     return true;
 }
 
-double Triangle::area() const
+double Triangle::pdfValue(const Vector3& o, const Vector3& v) const
 {
-    Vector3 u(v1 - v0);
-    Vector3 v(v2 - v0);
-    Vector3 uv = cross(u, v);
-    return 0.5 * uv.length();
+    // Unlike hit() this is two-sided: random() picks points on the triangle
+    // with the same density whichever side 'o' is on.
+    Vector3 edge1(v1 - v0);
+    Vector3 edge2(v2 - v0);
+    Vector3 pvec = cross(v, edge2);
+    double det = dot(edge1, pvec);
+    if (det == 0)
+        return 0;
+    const double invDet = 1 / det;
+
+    Vector3 tvec(o - v0);
+    double u = dot(tvec, pvec) * invDet;
+    if (u < 0 || u > 1)
+        return 0;
+    Vector3 qvec = cross(tvec, edge1);
+    double w = dot(v, qvec) * invDet;
+    if (w < 0 || u + w > 1)
+        return 0;
+    double t = dot(edge2, qvec) * invDet;
+    if (t < 0.001)
+        return 0;
+
+    Vector3 normal = unit_vector(cross(edge1, edge2));
+    double distSqrd = t * t * v.squared_length();
+    double cosine = fabs(dot(v, normal) / v.length());
+    return distSqrd / (cosine * surfaceArea);
+}
+
+Vector3 Triangle::random(const Vector3& o, Sampler& sampler) const
+{
+    // Uniform point on the triangle.
+    Vector2 u = sampler.get2D();
+    double su = sqrt(u.x());
+    double b0 = 1 - su;
+    double b1 = u.y() * su;
+    Vector3 randPoint = b0 * v0 + b1 * v1 + (1 - b0 - b1) * v2;
+    return randPoint - o;
+}
+
+Vector3 Triangle::power(const MaterialTable& materials) const
+{
+    return surfacePower(materials, material, area());
 }
 
 void Triangle::calcTexCoord(const Vector3& bary, Vector2& uv) const
@@ -110,8 +176,7 @@ void Triangle::calcBounds()
     bbox = AABB(bmin, bmax);
 }
 
-
-bool TriangleMesh::hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const
+bool TriangleMesh::intersect(const Ray &r, double t_min, double t_max, SurfaceHit &hit) const
 {
     return false;
 }
@@ -223,3 +288,4 @@ TriangleMesh::TriangleFast::TriangleFast(const Vector3& v0, const Vector3& v1, c
     m_cnu = c[v] * invDet;
     m_cnv = -c[u] * invDet;
 }
+
@@ -23,15 +23,25 @@ public:
     Triangle(const Vector3& v0, const Vector2& t0,
              const Vector3& v1, const Vector2& t1,
              const Vector3& v2, const Vector2& t2,
-             Material* mtl);
+             MaterialId mtl);
 
-    bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
+    bool intersect(const Ray &r, double t_min, double t_max, SurfaceHit &hit) const override;
+
+    void surface(const Ray &r, const SurfaceHit &hit, HitRecord &rec) const override;
 
     bool bounds(double t0, double t1, AABB &bbox) const override;
 
-    double area() const;
+    double pdfValue(const Vector3& o, const Vector3& v) const override;
+
+    Vector3 random(const Vector3& o, Sampler& sampler) const override;
+
+    double area() const override
+    { return surfaceArea; }
+
+    Vector3 power(const MaterialTable& materials) const override;
 
 private:
+    friend class ScenePackageWriter;
 
     void calcTexCoord(const Vector3& xyz, Vector2& uv) const;
     void calcBounds();
@@ -44,8 +54,9 @@ private:
     Vector2 t1;
     Vector2 t2;
 
-    Material* material;
+    MaterialId material;
 
+    double surfaceArea;
     AABB bbox;
 };
 
@@ -57,10 +68,10 @@ struct TriIndex
 class TriangleMesh : public Hitable
 {
 public:
-    explicit TriangleMesh(Material* mtl) :
+    explicit TriangleMesh(MaterialId mtl) :
         material(mtl) { }
 
-    bool hit(const Ray &r, double t_min, double t_max, HitRecord &rec) const override;
+    bool intersect(const Ray &r, double t_min, double t_max, SurfaceHit &hit) const override;
 
     bool bounds(double t0, double t1, AABB &bbox) const override;
 
@@ -96,7 +107,7 @@ private:
     std::vector<TriIndex> triangles;
     std::vector<TriangleFast> triAccel;
 
-    Material* material;
+    MaterialId material;
 
     AABB bbox{};
 };
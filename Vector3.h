@@ -185,6 +185,12 @@ inline bool refract(const Vector3& v, const Vector3& n, double niOverNt, Vector3
     return false;
 }
 
+// Rec. 709 luminance of a linear RGB color.
+inline double luminance(const Vector3& c)
+{
+    return 0.2126 * c.e[0] + 0.7152 * c.e[1] + 0.0722 * c.e[2];
+}
+
 inline std::istream& operator>>(std::istream& is, Vector3& t)
 {
     is >> t.e[0] >> t.e[1] >> t.e[2];
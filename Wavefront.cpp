@@ -0,0 +1,320 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include <cfloat>
+#include <algorithm>
+#include "Wavefront.h"
+#include "Material.h"
+#include "PDF.h"
+
+// Longest path, as in color_nr.
+static const int MAX_DEPTH = 50;
+
+// Spreads the low 10 bits of x to every third bit.
+static uint64_t expandBits(uint64_t x)
+{
+    x &= 0x3ffu;
+    x = (x | (x << 16u)) & 0x30000ffu;
+    x = (x | (x << 8u)) & 0x300f00fu;
+    x = (x | (x << 4u)) & 0x30c30c3u;
+    x = (x | (x << 2u)) & 0x9249249u;
+    return x;
+}
+
+WavefrontIntegrator::WavefrontIntegrator(const Camera& camera, const Scene& scene, Hitable* world,
+                                         Hitable* lightShape, int width, int height, const Options& options) :
+    m_camera(camera),
+    m_scene(scene),
+    m_world(world),
+    m_lightShape(lightShape),
+    m_width(width),
+    m_height(height),
+    m_options(options)
+{
+    if (m_options.sortRays && !m_world->bounds(0, 1, m_sceneBounds))
+        m_sceneBounds = AABB(Vector3(0, 0, 0), Vector3(0, 0, 0));
+}
+
+void WavefrontIntegrator::render(const std::vector<PathRequest>& batch, Sampler& sampler)
+{
+    generate(batch, sampler);
+    for (int bounce = 0; !m_rayQueue.empty(); bounce++)
+    {
+        if (bounce == 0 && m_options.cameraPackets)
+            intersectCameraPackets();
+        else
+        {
+            if (m_options.sortRays)
+                sortRays();
+            intersect();
+        }
+        if (m_options.sortHits)
+            sortHits();
+        shade(sampler);
+        traceShadowRays();
+        std::swap(m_rayQueue, m_nextRayQueue);
+    }
+}
+
+void WavefrontIntegrator::generate(const std::vector<PathRequest>& batch, Sampler& sampler)
+{
+    const size_t n = batch.size();
+    m_origin.resize(n);
+    m_direction.resize(n);
+    m_time.resize(n);
+    m_mediumSample.resize(n);
+    m_throughput.assign(n, Vector3(1, 1, 1));
+    m_radiance.assign(n, Vector3(0, 0, 0));
+    m_bsdfPdf.assign(n, 0);
+    m_coneWidth.assign(n, 0);
+    m_lastPoint.resize(n);
+    m_depth.assign(n, 0);
+    m_samplerState.resize(n);
+    m_hit.resize(n);
+    if (m_options.sortHits)
+        m_hitKeys.reserve(n);
+    m_request = batch;
+
+    m_rayQueue.clear();
+    for (size_t i = 0; i < n; i++)
+    {
+        const PathRequest& request = batch[i];
+        sampler.startSample(request.x, request.y, request.sampleIndex);
+        Vector2 jitter = sampler.get2D();
+        auto u = (request.x + jitter.x()) / double(m_width);
+        auto v = (request.y + jitter.y()) / double(m_height);
+        Ray r = m_camera.getRay(u, v, sampler);
+        m_origin[i] = r.origin();
+        m_direction[i] = r.direction();
+        m_time[i] = r.time();
+        sampler.setDimension(SampleDim::bounce(0, SampleDim::Medium));
+        m_mediumSample[i] = sampler.get1D();
+        sampler.saveState(m_samplerState[i]);
+        m_rayQueue.push_back(int(i));
+    }
+}
+
+void WavefrontIntegrator::intersect()
+{
+    m_shadeQueue.clear();
+    for (int i : m_rayQueue)
+    {
+        Ray ray(m_origin[i], m_direction[i], m_time[i]);
+        ray.setMediumSample(m_mediumSample[i]);
+        if (m_world->hit(ray, 0.001, DBL_MAX, m_hit[i]))
+            m_shadeQueue.push_back(i);
+        else
+            m_radiance[i] += m_throughput[i] * m_scene.ambient->emitted(ray);
+    }
+}
+
+void WavefrontIntegrator::intersectCameraPackets()
+{
+    // Group the camera rays by 8x8 pixel block and sample index.
+    const uint64_t blocksX = (uint64_t(m_width) + 7) / 8;
+    m_sortKeys.clear();
+    for (int i : m_rayQueue)
+    {
+        const PathRequest& request = m_request[i];
+        const uint64_t block = uint64_t(request.y / 8) * blocksX + uint64_t(request.x / 8);
+        m_sortKeys.emplace_back((block << 32u) | uint32_t(request.sampleIndex), i);
+    }
+    std::sort(m_sortKeys.begin(), m_sortKeys.end());
+
+    m_shadeQueue.clear();
+    RayPacket packet;
+    int paths[RayPacket::MAX_RAYS];
+    double tmax[RayPacket::MAX_RAYS];
+    SurfaceHit hits[RayPacket::MAX_RAYS];
+    for (size_t first = 0; first < m_sortKeys.size(); first += packet.count)
+    {
+        packet.count = 0;
+        while (packet.count < RayPacket::MAX_RAYS && first + packet.count < m_sortKeys.size() &&
+               m_sortKeys[first + packet.count].first == m_sortKeys[first].first)
+        {
+            const int i = m_sortKeys[first + packet.count].second;
+            paths[packet.count] = i;
+            tmax[packet.count] = DBL_MAX;
+            packet.rays[packet.count] = Ray(m_origin[i], m_direction[i], m_time[i]);
+            packet.rays[packet.count].setMediumSample(m_mediumSample[i]);
+            packet.count++;
+        }
+        packet.computeBounds();
+
+        const uint64_t hitMask = m_world->intersectPacket(packet, packet.all(), 0.001, tmax, hits);
+        for (int k = 0; k < packet.count; k++)
+        {
+            const int i = paths[k];
+            if (hitMask & RayPacket::bit(k))
+            {
+                hits[k].evaluate(packet.rays[k], m_hit[i]);
+                m_shadeQueue.push_back(i);
+            }
+            else
+            {
+                m_radiance[i] += m_throughput[i] * m_scene.ambient->emitted(packet.rays[k]);
+            }
+        }
+    }
+}
+
+void WavefrontIntegrator::shade(Sampler& sampler)
+{
+    m_nextRayQueue.clear();
+    m_shadowPath.clear();
+    m_shadowOrigin.clear();
+    m_shadowDirection.clear();
+    m_shadowTime.clear();
+    m_shadowMediumSample.clear();
+    m_shadowThroughput.clear();
+    m_shadowScale.clear();
+
+    for (int i : m_shadeQueue)
+    {
+        sampler.restoreState(m_samplerState[i]);
+        Ray currentRay(m_origin[i], m_direction[i], m_time[i]);
+        currentRay.setMediumSample(m_mediumSample[i]);
+        HitRecord& rec = m_hit[i];
+        m_coneWidth[i] += m_options.coneSpread * rec.t * currentRay.direction().length();
+        rec.setFootprint(currentRay, m_coneWidth[i]);
+        const Material& material = m_scene.materials[rec.material];
+        const int depth = m_depth[i];
+        Vector3& throughput = m_throughput[i];
+
+        ScatterRecord srec;
+        Vector3 emitted = material.emitted(currentRay, rec, rec.uv, rec.p);
+        if (m_bsdfPdf[i] > 0)
+        {
+            double lightPdf = m_lightShape->pdfValue(m_lastPoint[i], currentRay.direction());
+            emitted *= misWeight(m_bsdfPdf[i], lightPdf, m_options.powerHeuristic);
+        }
+        m_radiance[i] += throughput * emitted;
+
+        // The path ends at this vertex unless a continuation survives.
+        m_depth[i] = depth + 1;
+
+        sampler.setDimension(SampleDim::bounce(depth, SampleDim::Scatter));
+        if (!material.scatter(currentRay, rec, srec, sampler))
+            continue;
+
+        if (srec.isSpecular)
+        {
+            throughput *= srec.attenuation;
+            m_origin[i] = srec.specularRay.origin();
+            m_direction[i] = srec.specularRay.direction();
+            m_time[i] = srec.specularRay.time();
+            m_bsdfPdf[i] = 0;
+        }
+        else
+        {
+            if (m_lightShape != nullptr)
+            {
+                sampler.setDimension(SampleDim::bounce(depth, SampleDim::LightSelect));
+                Ray shadowRay(rec.p, m_lightShape->random(rec.p, sampler), currentRay.time());
+                sampler.setDimension(SampleDim::bounce(depth, SampleDim::ShadowMedium));
+                shadowRay.setMediumSample(sampler.get1D());
+                double lightPdf = m_lightShape->pdfValue(rec.p, shadowRay.direction());
+                if (lightPdf > 0)
+                {
+                    double scatteringPdf = material.scatteringPdf(currentRay, rec, shadowRay);
+                    double weight = misWeight(lightPdf, srec.pdf->value(shadowRay.direction()), m_options.powerHeuristic);
+                    m_shadowPath.push_back(i);
+                    m_shadowOrigin.push_back(shadowRay.origin());
+                    m_shadowDirection.push_back(shadowRay.direction());
+                    m_shadowTime.push_back(shadowRay.time());
+                    m_shadowMediumSample.push_back(shadowRay.mediumSample());
+                    m_shadowThroughput.push_back(throughput * srec.attenuation);
+                    m_shadowScale.push_back(scatteringPdf * weight / lightPdf);
+                }
+            }
+
+            sampler.setDimension(SampleDim::bounce(depth, SampleDim::Bsdf));
+            Ray scattered = Ray(rec.p, srec.pdf->generate(sampler), currentRay.time());
+            double pdfValue = srec.pdf->value(scattered.direction());
+            if (pdfValue <= 0)
+                continue;
+            throughput *= srec.attenuation * material.scatteringPdf(currentRay, rec, scattered) / pdfValue;
+            m_origin[i] = scattered.origin();
+            m_direction[i] = scattered.direction();
+            m_time[i] = scattered.time();
+            m_bsdfPdf[i] = (m_lightShape != nullptr) ? pdfValue : 0;
+            m_lastPoint[i] = rec.p;
+        }
+
+        if (m_options.rrDepth >= 0 && depth >= m_options.rrDepth)
+        {
+            double survive = std::min(0.95, std::max(throughput.x(), std::max(throughput.y(), throughput.z())));
+            sampler.setDimension(SampleDim::bounce(depth, SampleDim::Roulette));
+            if (!(sampler.get1D() < survive))
+                continue;
+            throughput /= survive;
+        }
+
+        if (depth + 1 < MAX_DEPTH)
+        {
+            sampler.setDimension(SampleDim::bounce(depth + 1, SampleDim::Medium));
+            m_mediumSample[i] = sampler.get1D();
+            sampler.saveState(m_samplerState[i]);
+            m_nextRayQueue.push_back(i);
+        }
+    }
+}
+
+void WavefrontIntegrator::traceShadowRays()
+{
+    for (size_t s = 0; s < m_shadowPath.size(); s++)
+    {
+        Ray shadowRay(m_shadowOrigin[s], m_shadowDirection[s], m_shadowTime[s]);
+        shadowRay.setMediumSample(m_shadowMediumSample[s]);
+        HitRecord lightRec;
+        if (m_world->hit(shadowRay, 0.001, DBL_MAX, lightRec))
+        {
+            Vector3 lightEmitted = m_scene.materials[lightRec.material].emitted(shadowRay, lightRec, lightRec.uv, lightRec.p);
+            m_radiance[m_shadowPath[s]] += m_shadowThroughput[s] * lightEmitted * m_shadowScale[s];
+        }
+    }
+}
+
+void WavefrontIntegrator::sortRays()
+{
+    const Vector3 lower = m_sceneBounds.min();
+    const Vector3 extent = m_sceneBounds.max() - lower;
+
+    m_sortKeys.clear();
+    for (int i : m_rayQueue)
+    {
+        const Vector3& d = m_direction[i];
+        const uint64_t octant = (d.x() < 0 ? 1u : 0u) | (d.y() < 0 ? 2u : 0u) | (d.z() < 0 ? 4u : 0u);
+        uint64_t morton = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            // Origins outside the bounds (the camera) clamp to its faces.
+            double t = (extent[axis] > 0) ? (m_origin[i][axis] - lower[axis]) / extent[axis] : 0;
+            t = std::min(std::max(t, 0.0), 1.0);
+            morton |= expandBits(uint64_t(t * 1023)) << uint64_t(2 - axis);
+        }
+        m_sortKeys.emplace_back((octant << 30u) | morton, i);
+    }
+    std::sort(m_sortKeys.begin(), m_sortKeys.end());
+    for (size_t k = 0; k < m_sortKeys.size(); k++)
+        m_rayQueue[k] = m_sortKeys[k].second;
+}
+
+void WavefrontIntegrator::sortHits()
+{
+    m_hitKeys.clear();
+    for (int i : m_shadeQueue)
+    {
+        const MaterialId material = m_hit[i].material;
+        m_hitKeys.push_back({m_scene.materials[material].type(), material, i});
+    }
+    std::sort(m_hitKeys.begin(), m_hitKeys.end());
+    for (size_t k = 0; k < m_hitKeys.size(); k++)
+        m_shadeQueue[k] = m_hitKeys[k].path;
+}
@@ -0,0 +1,153 @@
+/*
+ * Pathtracer based on Peter Shirley's 'Ray Tracing in One Weekend' e-book
+ * series.
+ *
+ * Copyright (C) 2017 by Rick Weyrauch - rpweyrauch@gmail.com
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#ifndef PATHTRACER_WAVEFRONT_H
+#define PATHTRACER_WAVEFRONT_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "Vector3.h"
+#include "Hitable.h"
+#include "AABB.h"
+#include "Camera.h"
+#include "Scene.h"
+#include "Sampler.h"
+
+//
+// Breadth-first version of the path tracer in main.cpp (color_nr).  A batch of
+// camera paths is advanced one bounce at a time, each stage running over the
+// whole batch before the next starts:
+//
+//   generate  - camera rays for every path
+//   intersect - closest hit of every live ray; misses add the ambient light
+//   shade     - emission, scattering, the light sample and Russian roulette
+//   shadow    - visibility of the light samples
+//
+// Path state is kept as structure of arrays indexed by path, and each stage
+// walks a queue of path indices, so a stage only touches the data it needs.
+//
+// Every path draws the same sampler dimensions in the same order as color_nr,
+// and its radiance is summed in the same order, so a deterministic render is
+// identical with either integrator.
+//
+// Optionally the rays are sorted before each intersection stage, by direction
+// octant and then along a Morton curve by origin, so consecutive rays visit
+// the same BVH nodes, and hits are sorted by material before shading, so
+// consecutive hits run the same scatter code.  Paths are independent, so the
+// order changes nothing in the image.
+//
+// The camera rays can also be intersected as packets, one per 8x8 block of
+// pixels and sample index, see BVH::intersectPacket.
+//
+// Laine, Karras and Aila, "Megakernels Considered Harmful: Wavefront Path
+// Tracing on GPUs", HPG 2013.
+//
+class WavefrontIntegrator
+{
+public:
+    // One path to trace: sample 'sampleIndex' of pixel (x, y), y counted from
+    // the bottom of the image.
+    struct PathRequest
+    {
+        int x, y;
+        int sampleIndex;
+    };
+
+    struct Options
+    {
+        int rrDepth = 3;
+        bool powerHeuristic = true;
+        bool sortRays = false;
+        bool sortHits = false;
+        bool cameraPackets = false;
+        double coneSpread = 0;      // of the ray cones that filter textures, see color_nr
+    };
+
+    WavefrontIntegrator(const Camera& camera, const Scene& scene, Hitable* world, Hitable* lightShape,
+                        int width, int height, const Options& options);
+
+    // Traces the batch to completion.  The sampler must give each sample its
+    // own sequence, see Sampler::State.
+    void render(const std::vector<PathRequest>& batch, Sampler& sampler);
+
+    // Results of the last batch, in batch order.
+    const Vector3& radiance(size_t path) const { return m_radiance[path]; }
+    int pathLength(size_t path) const { return m_depth[path]; }
+
+private:
+    void generate(const std::vector<PathRequest>& batch, Sampler& sampler);
+    void intersect();
+    void intersectCameraPackets();
+    void shade(Sampler& sampler);
+    void traceShadowRays();
+    void sortRays();
+    void sortHits();
+
+    const Camera& m_camera;
+    const Scene& m_scene;
+    Hitable* m_world;
+    Hitable* m_lightShape;
+    int m_width, m_height;
+    Options m_options;
+    AABB m_sceneBounds;
+
+    // Path state.
+    std::vector<PathRequest> m_request;
+    std::vector<Vector3> m_origin;
+    std::vector<Vector3> m_direction;
+    std::vector<double> m_time;
+    std::vector<double> m_mediumSample;
+    std::vector<Vector3> m_throughput;
+    std::vector<Vector3> m_radiance;
+    std::vector<double> m_bsdfPdf;      // as in color_nr, zero after specular bounces
+    std::vector<double> m_coneWidth;    // of the pixel's cone at the ray origin, as in color_nr
+    std::vector<Vector3> m_lastPoint;
+    std::vector<int> m_depth;
+    std::vector<Sampler::State> m_samplerState;
+    std::vector<HitRecord> m_hit;
+
+    // Queues of path indices.
+    std::vector<int> m_rayQueue;
+    std::vector<int> m_shadeQueue;
+    std::vector<int> m_nextRayQueue;
+
+    // Shadow rays towards the light samples, with the contribution of each
+    // before the emission of the light it reaches.
+    std::vector<int> m_shadowPath;
+    std::vector<Vector3> m_shadowOrigin;
+    std::vector<Vector3> m_shadowDirection;
+    std::vector<double> m_shadowTime;
+    std::vector<double> m_shadowMediumSample;
+    std::vector<Vector3> m_shadowThroughput;
+    std::vector<double> m_shadowScale;
+
+    std::vector<std::pair<uint64_t, int>> m_sortKeys;
+
+    // Hits grouped by the type of material, for the scatter code, then by the
+    // material itself, for its textures.
+    struct HitKey
+    {
+        size_t type;
+        MaterialId material;
+        int path;
+
+        bool operator<(const HitKey& other) const
+        {
+            if (type != other.type)
+                return type < other.type;
+            if (material != other.material)
+                return material < other.material;
+            return path < other.path;
+        }
+    };
+    std::vector<HitKey> m_hitKeys;
+};
+
+#endif //PATHTRACER_WAVEFRONT_H
@@ -10,6 +10,8 @@
 #include <iostream>
 #include <cfloat>
 #include <fstream>
+#include <memory>
+#include <chrono>
 #include "Sphere.h"
 #include "HitableList.h"
 #include "Vector3.h"
@@ -30,39 +32,46 @@
 #include "Progress.h"
 #include "Triangle.h"
 #include "AmbientLight.h"
-
-AmbientLight* g_ambientLight = new ConstantAmbient();
+#include "Sampler.h"
+#include "LightTree.h"
+#include "TileScheduler.h"
+#include "ThreadPool.h"
+#include "Numa.h"
+#include "Wavefront.h"
+#include "Scene.h"
+#include "SceneParser.h"
+#include "ScenePackage.h"
+#include "TextureCache.h"
 
 #define clamp(value, lower, upper) std::max(std::min((value), (upper)), (lower))
 
-Vector3 color(const Ray& r, Hitable* world, Hitable* lightShape, int depth)
+Vector3 color(const Ray& r, const Scene& scene, Hitable* world, Hitable* lightShape, int depth, Sampler& sampler)
 {
     HitRecord rec;
     if (world->hit(r, 0.001, DBL_MAX, rec)) {
         ScatterRecord srec;
-        Vector3 emitted = rec.material->emitted(r, rec, rec.uv, rec.p);
-        if (depth<50 && rec.material->scatter(r, rec, srec)) {
+        Vector3 emitted = scene.materials[rec.material].emitted(r, rec, rec.uv, rec.p);
+        sampler.setDimension(SampleDim::bounce(depth, SampleDim::Scatter));
+        if (depth<50 && scene.materials[rec.material].scatter(r, rec, srec, sampler)) {
             if (srec.isSpecular) {
-                return srec.attenuation * color(srec.specularRay, world, lightShape, depth+1);
+                return srec.attenuation * color(srec.specularRay, scene, world, lightShape, depth+1, sampler);
             }
             else {
                 if (lightShape != nullptr)
                 {
                     HitablePdf plight(lightShape, rec.p);
                     MixturePdf p(&plight, srec.pdf);
-                    Ray scattered = Ray(rec.p, p.generate(), r.time());
+                    Ray scattered = Ray(rec.p, p.generate(sampler), r.time());
                     double pdfValue = p.value(scattered.direction());
-                    delete srec.pdf;
-                    return emitted + srec.attenuation * rec.material->scatteringPdf(r, rec, scattered) *
-                                     color(scattered, world, lightShape, depth + 1) / pdfValue;
+                    return emitted + srec.attenuation * scene.materials[rec.material].scatteringPdf(r, rec, scattered) *
+                                     color(scattered, scene, world, lightShape, depth + 1, sampler) / pdfValue;
                 }
                 else
                 {
-                    Ray scattered = Ray(rec.p, srec.pdf->generate(), r.time());
+                    Ray scattered = Ray(rec.p, srec.pdf->generate(sampler), r.time());
                     double pdfValue = srec.pdf->value(scattered.direction());
-                    delete srec.pdf;
-                    return emitted + srec.attenuation * rec.material->scatteringPdf(r, rec, scattered) *
-                                     color(scattered, world, lightShape, depth + 1) / pdfValue;
+                    return emitted + srec.attenuation * scene.materials[rec.material].scatteringPdf(r, rec, scattered) *
+                                     color(scattered, scene, world, lightShape, depth + 1, sampler) / pdfValue;
                 }
             }
         }
@@ -71,68 +80,133 @@ Vector3 color(const Ray& r, Hitable* world, Hitable* lightShape, int depth)
         }
     }
     else {
-        return g_ambientLight->emitted(r);
+        return scene.ambient->emitted(r);
     }
 }
 
-Vector3 color_nr(const Ray& r, Hitable* world, Hitable* lightShape)
+//
+// Iterative path tracer.  Radiance is accumulated as throughput * emitted at
+// every vertex.  At each diffuse vertex the light shapes are sampled explicitly
+// (next-event estimation) with a shadow ray, and the result is combined with
+// the BSDF sampled continuation using multiple importance sampling.
+//
+// After rrDepth bounces paths are terminated by Russian roulette with a
+// survival probability proportional to their throughput, which keeps the
+// estimate unbiased (rrDepth < 0 disables it).  pathLength returns the number
+// of surfaces the path hit.
+//
+// Textures are filtered over the cone of the sample, widening by 'spread' per
+// unit of distance along the whole path, see coneSpread().  The spread is kept
+// at every bounce, which underestimates the footprint after a diffuse one,
+// where the blur of the bounce itself hides the difference.
+//
+Vector3 color_nr(const Ray& r, double spread, const Scene& scene, Hitable* world, Hitable* lightShape, Sampler& sampler,
+                 int rrDepth, bool powerHeuristic, int& pathLength)
 {
-    Vector3 accumCol(1, 1, 1);
+    Vector3 radiance(0, 0, 0);
+    Vector3 throughput(1, 1, 1);
 
     Ray currentRay(r);
 
-    for (int depth = 0; depth < 50; depth++)
+    // Density of the BSDF sample that produced currentRay; zero when the light
+    // shapes were not sampled at the previous vertex (camera ray, specular
+    // bounce), in which case emission is counted with full weight.
+    double bsdfPdf = 0;
+    Vector3 lastPoint{};
+    double coneWidth = 0;
+
+    int depth = 0;
+    for (; depth < 50; depth++)
     {
+        sampler.setDimension(SampleDim::bounce(depth, SampleDim::Medium));
+        currentRay.setMediumSample(sampler.get1D());
+
         HitRecord rec;
         if (world->hit(currentRay, 0.001, DBL_MAX, rec))
         {
+            coneWidth += spread * rec.t * currentRay.direction().length();
+            rec.setFootprint(currentRay, coneWidth);
+            const Material& material = scene.materials[rec.material];
             ScatterRecord srec;
-            Vector3 emitted = rec.material->emitted(currentRay, rec, rec.uv, rec.p);
-            if (rec.material->scatter(currentRay, rec, srec))
+            Vector3 emitted = material.emitted(currentRay, rec, rec.uv, rec.p);
+            if (bsdfPdf > 0)
+            {
+                double lightPdf = lightShape->pdfValue(lastPoint, currentRay.direction());
+                emitted *= misWeight(bsdfPdf, lightPdf, powerHeuristic);
+            }
+            radiance += throughput * emitted;
+
+            sampler.setDimension(SampleDim::bounce(depth, SampleDim::Scatter));
+            if (material.scatter(currentRay, rec, srec, sampler))
             {
                 if (srec.isSpecular)
                 {
-                    accumCol *= srec.attenuation;
+                    throughput *= srec.attenuation;
                     currentRay = srec.specularRay;
+                    bsdfPdf = 0;
                 }
                 else
                 {
                     if (lightShape != nullptr)
                     {
-                        HitablePdf plight(lightShape, rec.p);
-                        MixturePdf p(&plight, srec.pdf);
-                        Ray scattered = Ray(rec.p, p.generate(), currentRay.time());
-                        double pdfValue = p.value(scattered.direction());
-                        delete srec.pdf;
-                        accumCol *= (emitted + (srec.attenuation * rec.material->scatteringPdf(currentRay, rec, scattered)) / pdfValue);
-                        currentRay = scattered;
+                        sampler.setDimension(SampleDim::bounce(depth, SampleDim::LightSelect));
+                        Ray shadowRay(rec.p, lightShape->random(rec.p, sampler), currentRay.time());
+                        sampler.setDimension(SampleDim::bounce(depth, SampleDim::ShadowMedium));
+                        shadowRay.setMediumSample(sampler.get1D());
+                        double lightPdf = lightShape->pdfValue(rec.p, shadowRay.direction());
+                        HitRecord lightRec;
+                        if (lightPdf > 0 && world->hit(shadowRay, 0.001, DBL_MAX, lightRec))
+                        {
+                            Vector3 lightEmitted = scene.materials[lightRec.material].emitted(shadowRay, lightRec, lightRec.uv, lightRec.p);
+                            double scatteringPdf = material.scatteringPdf(currentRay, rec, shadowRay);
+                            double weight = misWeight(lightPdf, srec.pdf->value(shadowRay.direction()), powerHeuristic);
+                            radiance += throughput * srec.attenuation * lightEmitted * (scatteringPdf * weight / lightPdf);
+                        }
+                    }
+
+                    sampler.setDimension(SampleDim::bounce(depth, SampleDim::Bsdf));
+                    Ray scattered = Ray(rec.p, srec.pdf->generate(sampler), currentRay.time());
+                    double pdfValue = srec.pdf->value(scattered.direction());
+                    if (pdfValue <= 0)
+                    {
+                        depth++;
+                        break;
                     }
-                    else
+                    throughput *= srec.attenuation * material.scatteringPdf(currentRay, rec, scattered) / pdfValue;
+                    currentRay = scattered;
+                    bsdfPdf = (lightShape != nullptr) ? pdfValue : 0;
+                    lastPoint = rec.p;
+                }
+
+                if (rrDepth >= 0 && depth >= rrDepth)
+                {
+                    double survive = std::min(0.95, std::max(throughput.x(), std::max(throughput.y(), throughput.z())));
+                    sampler.setDimension(SampleDim::bounce(depth, SampleDim::Roulette));
+                    if (!(sampler.get1D() < survive))
                     {
-                        Ray scattered = Ray(rec.p, srec.pdf->generate(), currentRay.time());
-                        double pdfValue = srec.pdf->value(scattered.direction());
-                        delete srec.pdf;
-                        accumCol *= (emitted + (srec.attenuation * rec.material->scatteringPdf(currentRay, rec, scattered)) / pdfValue);
-                        currentRay = scattered;
+                        depth++;
+                        break;
                     }
+                    throughput /= survive;
                 }
             }
             else
             {
-                accumCol *= emitted;
+                depth++;
                 break;
             }
         }
         else
         {
-            accumCol *= g_ambientLight->emitted(r);
+            radiance += throughput * scene.ambient->emitted(currentRay);
             break;
         }
     }
-    return accumCol;
+    pathLength = depth;
+    return radiance;
 }
 
-Hitable* twoSpheres(double aspect, Camera& camera, std::vector<Hitable*>& lights)
+Hitable* twoSpheres(double aspect, Camera& camera, Random& rng, Scene& scene, Arena& arena)
 {
     const Vector3 lookFrom(13, 2, 3);
     const Vector3 lookAt(0, 0, 0);
@@ -140,18 +214,17 @@ Hitable* twoSpheres(double aspect, Camera& camera, std::vector<Hitable*>& lights
     const double aperture = 0.0;
     camera = Camera(lookFrom, lookAt, Vector3(0, 1, 0), 20, aspect, aperture, dist_to_focus);
 
-    Texture* checker = new CheckerTexture(new ConstantTexture(Vector3(0.2, 0.3, 0.1)), new ConstantTexture(Vector3(0.9, 0.9, 0.9)));
+    Texture* checker = arena.make<CheckerTexture>(arena.make<ConstantTexture>(Vector3(0.2, 0.3, 0.1)), arena.make<ConstantTexture>(Vector3(0.9, 0.9, 0.9)));
     std::vector<Hitable*> list;
-    list.push_back(new Sphere(Vector3(0,-10, 0), 10, new Lambertian(checker)));
-    list.push_back(new Sphere(Vector3(0, 10, 0), 10, new Lambertian(checker)));
+    list.push_back(arena.make<Sphere>(Vector3(0,-10, 0), 10, scene.materials.add(Lambertian(checker))));
+    list.push_back(arena.make<Sphere>(Vector3(0, 10, 0), 10, scene.materials.add(Lambertian(checker))));
 
-    delete g_ambientLight;
-    g_ambientLight = new SkyAmbient();
+    scene.ambient = arena.make<SkyAmbient>();
 
-    return new HitableList(list);
+    return arena.make<HitableList>(list);
 }
 
-Hitable* randomScene(double aspect, Camera& camera, std::vector<Hitable*>& lights)
+Hitable* randomScene(double aspect, Camera& camera, Random& rng, Scene& scene, Arena& arena)
 {
     const Vector3 lookFrom(13, 2, 3);
     const Vector3 lookAt(0, 0, 0);
@@ -160,43 +233,42 @@ Hitable* randomScene(double aspect, Camera& camera, std::vector<Hitable*>& light
     camera = Camera(lookFrom, lookAt, Vector3(0, 1, 0), 20, aspect, aperture, dist_to_focus, 0.0, 1.0);
 
     std::vector<Hitable*> list;
-    Texture* checker = new CheckerTexture(new ConstantTexture(Vector3(0.2, 0.3, 0.1)), new ConstantTexture(Vector3(0.9, 0.9, 0.9)));
-    list.push_back(new Sphere(Vector3(0,-1000,0), 1000, new Lambertian(checker)));
+    Texture* checker = arena.make<CheckerTexture>(arena.make<ConstantTexture>(Vector3(0.2, 0.3, 0.1)), arena.make<ConstantTexture>(Vector3(0.9, 0.9, 0.9)));
+    list.push_back(arena.make<Sphere>(Vector3(0,-1000,0), 1000, scene.materials.add(Lambertian(checker))));
     for (int a = -11; a < 11; a++)
     {
         for (int b = -11; b < 11; b++)
         {
-            double choose_mat = drand48();
-            Vector3 center(a+0.9*drand48(),0.2,b+0.9*drand48());
+            double choose_mat = rng.nextDouble();
+            Vector3 center(a+0.9*rng.nextDouble(),0.2,b+0.9*rng.nextDouble());
             if ((center-Vector3(4,0.2,0)).length() > 0.9)
             {
                 if (choose_mat < 0.8) // diffuse
                 {
-                    list.push_back(new MovingSphere(center, center+Vector3(0, 0.5*drand48(),0), 0, 1, 0.2, new Lambertian(new ConstantTexture(Vector3(drand48()*drand48(), drand48()*drand48(), drand48()*drand48())))));
+                    list.push_back(arena.make<MovingSphere>(center, center+Vector3(0, 0.5*rng.nextDouble(),0), 0, 1, 0.2, scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(rng.nextDouble()*rng.nextDouble(), rng.nextDouble()*rng.nextDouble(), rng.nextDouble()*rng.nextDouble()))))));
                 }
                 else if (choose_mat < 0.95) // metal
                 {
-                    list.push_back(new Sphere(center, 0.2, new Metal(Vector3(0.5*(1+drand48()), 0.5*(1+drand48()), 0.5*drand48()), 0.3)));
+                    list.push_back(arena.make<Sphere>(center, 0.2, scene.materials.add(Metal(Vector3(0.5*(1+rng.nextDouble()), 0.5*(1+rng.nextDouble()), 0.5*rng.nextDouble()), 0.3))));
                 }
                 else // glass
                 {
-                    list.push_back(new Sphere(center, 0.2, new Dielectric(1.5)));
+                    list.push_back(arena.make<Sphere>(center, 0.2, scene.materials.add(Dielectric(1.5))));
                 }
             }
         }
     }
 
-    list.push_back(new Sphere(Vector3(0,1,0), 1.0, new Dielectric(1.5)));
-    list.push_back(new Sphere(Vector3(-4, 1, 0), 1.0, new Lambertian(new ConstantTexture(Vector3(0.4, 0.2, 0.1)))));
-    list.push_back(new Sphere(Vector3(4, 1, 0), 1.0, new Metal(Vector3(0.7, 0.6, 0.5), 0.0)));
+    list.push_back(arena.make<Sphere>(Vector3(0,1,0), 1.0, scene.materials.add(Dielectric(1.5))));
+    list.push_back(arena.make<Sphere>(Vector3(-4, 1, 0), 1.0, scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.4, 0.2, 0.1))))));
+    list.push_back(arena.make<Sphere>(Vector3(4, 1, 0), 1.0, scene.materials.add(Metal(Vector3(0.7, 0.6, 0.5), 0.0))));
 
-    delete g_ambientLight;
-    g_ambientLight = new SkyAmbient();
+    scene.ambient = arena.make<SkyAmbient>();
 
-    return new HitableList(list);
+    return arena.make<HitableList>(list);
 }
 
-Hitable* perlinSpheres(double aspect, Camera& camera, std::vector<Hitable*>& lights)
+Hitable* perlinSpheres(double aspect, Camera& camera, Random& rng, Scene& scene, Arena& arena)
 {
     const Vector3 lookFrom(13, 2, 3);
     const Vector3 lookAt(0, 0, 0);
@@ -204,21 +276,25 @@ Hitable* perlinSpheres(double aspect, Camera& camera, std::vector<Hitable*>& lig
     const double aperture = 0.0;
     camera = Camera(lookFrom, lookAt, Vector3(0, 1, 0), 20, aspect, aperture, dist_to_focus);
 
-    int nx, ny, nz;
-    unsigned char* tex_data = stbi_load("earthmap.jpg", &nx, &ny, &nz, 0);
+    std::string error;
+    Texture* earth = TextureCache::instance().image("earthmap.jpg", error);
+    if (earth == nullptr)
+    {
+        std::cerr << error << std::endl;
+        return nullptr;
+    }
 
-    Texture* noise = new NoiseTexture(4); // ConstantTexture(Vector3(0.5, 0.5, 0.5)); //
+    Texture* noise = arena.make<NoiseTexture>(4); // ConstantTexture(Vector3(0.5, 0.5, 0.5)); //
     std::vector<Hitable*> list;
-    list.push_back(new Sphere(Vector3(0,-1000, 0), 1000, new Lambertian(noise)));
-    list.push_back(new Sphere(Vector3(0, 2, 0), 2, new Lambertian(new ImageTexture(tex_data, nx, ny))));
+    list.push_back(arena.make<Sphere>(Vector3(0,-1000, 0), 1000, scene.materials.add(Lambertian(noise))));
+    list.push_back(arena.make<Sphere>(Vector3(0, 2, 0), 2, scene.materials.add(Lambertian(earth))));
 
-    delete g_ambientLight;
-    g_ambientLight = new SkyAmbient();
+    scene.ambient = arena.make<SkyAmbient>();
 
-    return new HitableList(list);
+    return arena.make<HitableList>(list);
 }
 
-Hitable* simpleLight(double aspect, Camera& camera, std::vector<Hitable*>& lights)
+Hitable* simpleLight(double aspect, Camera& camera, Random& rng, Scene& scene, Arena& arena)
 {
     const Vector3 lookFrom(13, 2, 3);
     const Vector3 lookAt(0, 0, 0);
@@ -226,21 +302,19 @@ Hitable* simpleLight(double aspect, Camera& camera, std::vector<Hitable*>& light
     const double aperture = 0.0;
     camera = Camera(lookFrom, lookAt, Vector3(0, 1, 0), 20, aspect, aperture, dist_to_focus);
 
-    Texture* noise = new NoiseTexture(4); // ConstantTexture(Vector3(0.5, 0.5, 0.5)); //
+    Texture* noise = arena.make<NoiseTexture>(4); // ConstantTexture(Vector3(0.5, 0.5, 0.5)); //
     std::vector<Hitable*> list;
-    list.push_back(new Sphere(Vector3(0,-1000, 0), 1000, new Lambertian(noise)));
-    list.push_back(new Sphere(Vector3(0, 2, 0), 2, new Lambertian(noise)));
-
-    list.push_back(new Sphere(Vector3(0, 7, 0), 2, new DiffuseLight(new ConstantTexture(Vector3(4, 4, 4)))));
-    list.push_back(new XYRectangle(3, 5, 1, 3, -2, new DiffuseLight(new ConstantTexture(Vector3(4, 4, 4)))));
+    list.push_back(arena.make<Sphere>(Vector3(0,-1000, 0), 1000, scene.materials.add(Lambertian(noise))));
+    list.push_back(arena.make<Sphere>(Vector3(0, 2, 0), 2, scene.materials.add(Lambertian(noise))));
 
-    lights.push_back(new Sphere(Vector3(0, 7, 0), 2, nullptr));
-    lights.push_back(new XYRectangle(3, 5, 1, 3, -2, nullptr));
+    MaterialId light = scene.materials.add(DiffuseLight(arena.make<ConstantTexture>(Vector3(4, 4, 4))));
+    list.push_back(arena.make<Sphere>(Vector3(0, 7, 0), 2, light));
+    list.push_back(arena.make<XYRectangle>(3, 5, 1, 3, -2, light));
 
-    return new HitableList(list);
+    return arena.make<HitableList>(list);
 }
 
-Hitable* cornellBox(double aspect, Camera& camera, std::vector<Hitable*>& lights)
+Hitable* cornellBox(double aspect, Camera& camera, Random& rng, Scene& scene, Arena& arena)
 {
     const Vector3 lookFrom(278, 278, -800);
     const Vector3 lookAt(278, 278, 0);
@@ -250,43 +324,41 @@ Hitable* cornellBox(double aspect, Camera& camera, std::vector<Hitable*>& lights
 
     std::vector<Hitable*> list;
 
-    Material* red = new Lambertian(new ConstantTexture(Vector3(0.65, 0.05, 0.05)));
-    Material* white = new Lambertian(new ConstantTexture(Vector3(0.73, 0.73, 0.73)));
-    Material* green = new Lambertian(new ConstantTexture(Vector3(0.12, 0.45, 0.15)));
-    Material* light = new DiffuseLight(new ConstantTexture(Vector3(15, 15, 15)));
-    Material* aluminum = new Metal(Vector3(0.8, 0.85, 0.88), 0.0);
-    Material* glass = new Dielectric(1.5);
+    MaterialId red = scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.65, 0.05, 0.05))));
+    MaterialId white = scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.73, 0.73, 0.73))));
+    MaterialId green = scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.12, 0.45, 0.15))));
+    MaterialId light = scene.materials.add(DiffuseLight(arena.make<ConstantTexture>(Vector3(15, 15, 15))));
+    MaterialId aluminum = scene.materials.add(Metal(Vector3(0.8, 0.85, 0.88), 0.0));
+    MaterialId glass = scene.materials.add(Dielectric(1.5));
 
-    list.push_back(new FlipNormals(new YZRectangle(0, 555, 0, 555, 555, green)));
-    list.push_back(new YZRectangle(0, 555, 0, 555, 0, red));
-    list.push_back(new FlipNormals(new XZRectangle(213, 343, 227, 332, 554, light)));
-    list.push_back(new FlipNormals(new XZRectangle(0, 555, 0, 555, 555, white)));
-    list.push_back(new XZRectangle(0, 555, 0, 555, 0, white));
-    list.push_back(new FlipNormals(new XYRectangle(0, 555, 0, 555, 555, white)));
+    list.push_back(arena.make<FlipNormals>(arena.make<YZRectangle>(0, 555, 0, 555, 555, green)));
+    list.push_back(arena.make<YZRectangle>(0, 555, 0, 555, 0, red));
+    list.push_back(arena.make<FlipNormals>(arena.make<XZRectangle>(213, 343, 227, 332, 554, light)));
+    list.push_back(arena.make<FlipNormals>(arena.make<XZRectangle>(0, 555, 0, 555, 555, white)));
+    list.push_back(arena.make<XZRectangle>(0, 555, 0, 555, 0, white));
+    list.push_back(arena.make<FlipNormals>(arena.make<XYRectangle>(0, 555, 0, 555, 555, white)));
 
-    list.push_back(new Translate(new RotateY(new Box(Vector3(0, 0, 0), Vector3(165, 165, 165), white), -18), Vector3(130, 0, 65)));
-    list.push_back(new Translate(new RotateY(new Box(Vector3(0, 0, 0), Vector3(165, 330, 165), white), 15), Vector3(265, 0, 295)));
-    //list.push_back(new Translate(new Box(Vector3(0, 0, 0), Vector3(165, 330, 165), aluminum), Vector3(265, 0, 295)));
-    //list.push_back(new Sphere(Vector3(190, 90, 190), 90, glass));
+    list.push_back(arena.make<Translate>(arena.make<RotateY>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 165, 165), white, arena), -18), Vector3(130, 0, 65)));
+    list.push_back(arena.make<Translate>(arena.make<RotateY>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 330, 165), white, arena), 15), Vector3(265, 0, 295)));
+    //list.push_back(arena.make<Translate>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 330, 165), aluminum, arena), Vector3(265, 0, 295)));
+    //list.push_back(arena.make<Sphere>(Vector3(190, 90, 190), 90, glass));
 
-    //list.push_back(new Translate(new Box(Vector3(0, 0, 0), Vector3(165, 165, 165), white), Vector3(130, 0, 65)));
-    //list.push_back(new Translate(new Box(Vector3(0, 0, 0), Vector3(165, 330, 165), white), Vector3(265, 0, 295)));
+    //list.push_back(arena.make<Translate>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 165, 165), white, arena), Vector3(130, 0, 65)));
+    //list.push_back(arena.make<Translate>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 330, 165), white, arena), Vector3(265, 0, 295)));
 
-    //Hitable* b1 = new Translate(new RotateY(new Box(Vector3(0, 0, 0), Vector3(165, 165, 165), white), -18), Vector3(130, 0, 65));
-    //Hitable* b2 = new Translate(new RotateY(new Box(Vector3(0, 0, 0), Vector3(165, 330, 165), white), 15), Vector3(265, 0, 295));
+    //Hitable* b1 = arena.make<Translate>(arena.make<RotateY>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 165, 165), white, arena), -18), Vector3(130, 0, 65));
+    //Hitable* b2 = arena.make<Translate>(arena.make<RotateY>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 330, 165), white, arena), 15), Vector3(265, 0, 295));
 
-    //list.push_back(new ConstantMedium(b1, 0.01, new ConstantTexture(Vector3(1, 1, 1))));
-    //list.push_back(new ConstantMedium(b2, 0.01, new ConstantTexture(Vector3(0, 0, 0))));
+    //list.push_back(arena.make<ConstantMedium>(b1, 0.01, arena.make<ConstantTexture>(Vector3(1, 1, 1))));
+    //list.push_back(arena.make<ConstantMedium>(b2, 0.01, arena.make<ConstantTexture>(Vector3(0, 0, 0))));
 
-    lights.push_back(new XZRectangle(213, 343, 227, 332, 554, nullptr));
 
-    delete g_ambientLight;
-    g_ambientLight = new SkyAmbient();
+    scene.ambient = arena.make<SkyAmbient>();
 
-    return new HitableList(list);
+    return arena.make<HitableList>(list);
 }
 
-Hitable* cornellBoxTris(double aspect, Camera& camera, std::vector<Hitable*>& lights)
+Hitable* cornellBoxTris(double aspect, Camera& camera, Random& rng, Scene& scene, Arena& arena)
 {
     const Vector3 lookFrom(278, 278, -800);
     const Vector3 lookAt(278, 278, 0);
@@ -296,50 +368,48 @@ Hitable* cornellBoxTris(double aspect, Camera& camera, std::vector<Hitable*>& li
 
     std::vector<Hitable*> list;
 
-    Material* red = new Lambertian(new ConstantTexture(Vector3(0.65, 0.05, 0.05)));
-    Material* white = new Lambertian(new ConstantTexture(Vector3(0.73, 0.73, 0.73)));
-    Material* green = new Lambertian(new ConstantTexture(Vector3(0.12, 0.45, 0.15)));
-    Material* light = new DiffuseLight(new ConstantTexture(Vector3(15, 15, 15)));
-    Material* aluminum = new Metal(Vector3(0.8, 0.85, 0.88), 0.0);
-    Material* glass = new Dielectric(1.5);
-
-    //list.push_back(new FlipNormals(new YZRectangle(0, 555, 0, 555, 555, green)));
-    //list.push_back(new YZRectangle(0, 555, 0, 555, 0, red));
-    list.push_back(new FlipNormals(new XZRectangle(213, 343, 227, 332, 554, light)));
-    list.push_back(new FlipNormals(new XZRectangle(0, 555, 0, 555, 555, white)));
-    list.push_back(new XZRectangle(0, 555, 0, 555, 0, white));
-    list.push_back(new FlipNormals(new XYRectangle(0, 555, 0, 555, 555, white)));
-
-    list.push_back(new Triangle(Vector3(555, 0, 0), Vector2(0, 0), Vector3(555, 555, 555), Vector2(1, 1),
+    MaterialId red = scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.65, 0.05, 0.05))));
+    MaterialId white = scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.73, 0.73, 0.73))));
+    MaterialId green = scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.12, 0.45, 0.15))));
+    MaterialId light = scene.materials.add(DiffuseLight(arena.make<ConstantTexture>(Vector3(15, 15, 15))));
+    MaterialId aluminum = scene.materials.add(Metal(Vector3(0.8, 0.85, 0.88), 0.0));
+    MaterialId glass = scene.materials.add(Dielectric(1.5));
+
+    //list.push_back(arena.make<FlipNormals>(arena.make<YZRectangle>(0, 555, 0, 555, 555, green)));
+    //list.push_back(arena.make<YZRectangle>(0, 555, 0, 555, 0, red));
+    list.push_back(arena.make<FlipNormals>(arena.make<XZRectangle>(213, 343, 227, 332, 554, light)));
+    list.push_back(arena.make<FlipNormals>(arena.make<XZRectangle>(0, 555, 0, 555, 555, white)));
+    list.push_back(arena.make<XZRectangle>(0, 555, 0, 555, 0, white));
+    list.push_back(arena.make<FlipNormals>(arena.make<XYRectangle>(0, 555, 0, 555, 555, white)));
+
+    list.push_back(arena.make<Triangle>(Vector3(555, 0, 0), Vector2(0, 0), Vector3(555, 555, 555), Vector2(1, 1),
                                 Vector3(555, 555, 0), Vector2(1, 0), green));
-    list.push_back(new Triangle(Vector3(555, 555, 555), Vector2(1, 1), Vector3(555, 0, 0), Vector2(0, 0),
+    list.push_back(arena.make<Triangle>(Vector3(555, 555, 555), Vector2(1, 1), Vector3(555, 0, 0), Vector2(0, 0),
                                 Vector3(555, 0, 555), Vector2(0, 1), green));
 
-    list.push_back(new Triangle(Vector3(0, 0, 0), Vector2(0, 0), Vector3(0, 555, 0), Vector2(1, 0),
+    list.push_back(arena.make<Triangle>(Vector3(0, 0, 0), Vector2(0, 0), Vector3(0, 555, 0), Vector2(1, 0),
                                 Vector3(0, 555, 555), Vector2(1, 1), red));
-    list.push_back(new Triangle(Vector3(0, 555, 555), Vector2(1, 1), Vector3(0, 0, 555), Vector2(0, 1),
+    list.push_back(arena.make<Triangle>(Vector3(0, 555, 555), Vector2(1, 1), Vector3(0, 0, 555), Vector2(0, 1),
                                 Vector3(0, 0, 0), Vector2(0, 0), red));
 
-    list.push_back(new Translate(new RotateY(new Box(Vector3(0, 0, 0), Vector3(165, 165, 165), white), -18), Vector3(130, 0, 65)));
-    list.push_back(new Translate(new RotateY(new Box(Vector3(0, 0, 0), Vector3(165, 330, 165), aluminum), 15), Vector3(265, 0, 295)));
-    //list.push_back(new Translate(new Box(Vector3(0, 0, 0), Vector3(165, 330, 165), aluminum), Vector3(265, 0, 295)));
-    //list.push_back(new Sphere(Vector3(190, 90, 190), 90, glass));
+    list.push_back(arena.make<Translate>(arena.make<RotateY>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 165, 165), white, arena), -18), Vector3(130, 0, 65)));
+    list.push_back(arena.make<Translate>(arena.make<RotateY>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 330, 165), aluminum, arena), 15), Vector3(265, 0, 295)));
+    //list.push_back(arena.make<Translate>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 330, 165), aluminum, arena), Vector3(265, 0, 295)));
+    //list.push_back(arena.make<Sphere>(Vector3(190, 90, 190), 90, glass));
 
-    //list.push_back(new Translate(new Box(Vector3(0, 0, 0), Vector3(165, 165, 165), white), Vector3(130, 0, 65)));
-    //list.push_back(new Translate(new Box(Vector3(0, 0, 0), Vector3(165, 330, 165), white), Vector3(265, 0, 295)));
+    //list.push_back(arena.make<Translate>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 165, 165), white, arena), Vector3(130, 0, 65)));
+    //list.push_back(arena.make<Translate>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 330, 165), white, arena), Vector3(265, 0, 295)));
 
-    //Hitable* b1 = new Translate(new RotateY(new Box(Vector3(0, 0, 0), Vector3(165, 165, 165), white), -18), Vector3(130, 0, 65));
-    //Hitable* b2 = new Translate(new RotateY(new Box(Vector3(0, 0, 0), Vector3(165, 330, 165), white), 15), Vector3(265, 0, 295));
+    //Hitable* b1 = arena.make<Translate>(arena.make<RotateY>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 165, 165), white, arena), -18), Vector3(130, 0, 65));
+    //Hitable* b2 = arena.make<Translate>(arena.make<RotateY>(arena.make<Box>(Vector3(0, 0, 0), Vector3(165, 330, 165), white, arena), 15), Vector3(265, 0, 295));
 
-    //list.push_back(new ConstantMedium(b1, 0.01, new ConstantTexture(Vector3(1, 1, 1))));
-    //list.push_back(new ConstantMedium(b2, 0.01, new ConstantTexture(Vector3(0, 0, 0))));
+    //list.push_back(arena.make<ConstantMedium>(b1, 0.01, arena.make<ConstantTexture>(Vector3(1, 1, 1))));
+    //list.push_back(arena.make<ConstantMedium>(b2, 0.01, arena.make<ConstantTexture>(Vector3(0, 0, 0))));
 
-    lights.push_back(new XZRectangle(213, 343, 227, 332, 554, nullptr));
-
-    return new HitableList(list);
+    return arena.make<HitableList>(list);
 }
 
-Hitable* final(double aspect, Camera& camera, std::vector<Hitable*>& lights)
+Hitable* final(double aspect, Camera& camera, Random& rng, Scene& scene, Arena& arena)
 {
     const Vector3 lookFrom(478, 278, -600); //(278, 278, -800); //(13, 2, 3);
     const Vector3 lookAt(278, 278, 0); //(0, 1, 0);
@@ -347,10 +417,16 @@ Hitable* final(double aspect, Camera& camera, std::vector<Hitable*>& lights)
     const double aperture = 0.0;
     camera = Camera(lookFrom, lookAt, Vector3(0, 1, 0), 40, aspect, aperture, dist_to_focus);
 
+    // Decode the earth texture while the rest of the scene is built.
+    std::string error;
+    Texture* earth = nullptr;
+    ThreadPool::TaskGroup textureLoad;
+    ThreadPool::instance().run(textureLoad, [&]() { earth = TextureCache::instance().image("earthmap.jpg", error); });
+
     int nb = 20;
     std::vector<Hitable *> list;
-    Material* white = new Lambertian(new ConstantTexture(Vector3(0.73, 0.73, 0.73)));
-    Material* ground = new Lambertian(new ConstantTexture(Vector3(0.48, 0.83, 0.53)));
+    MaterialId white = scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.73, 0.73, 0.73))));
+    MaterialId ground = scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.48, 0.83, 0.53))));
     std::vector<Hitable*> boxList, boxList2;
     for (int i = 0; i < nb; i++)
     {
@@ -361,44 +437,94 @@ Hitable* final(double aspect, Camera& camera, std::vector<Hitable*>& lights)
             double z0 = -1000 + j*w;
             double y0 = 0;
             double x1 = x0 + w;
-            double y1 = 100*(drand48()+0.01);
+            double y1 = 100*(rng.nextDouble()+0.01);
             double z1 = z0 + w;
-            boxList.push_back(new Box(Vector3(x0, y0, z0), Vector3(x1, y1, z1), ground));
+            boxList.push_back(arena.make<Box>(Vector3(x0, y0, z0), Vector3(x1, y1, z1), ground, arena));
         }
     }
 
-    list.push_back(new BVH(boxList, 0, 1));
-    Material* light = new DiffuseLight(new ConstantTexture(Vector3(6, 6, 6)));
-    list.push_back(new FlipNormals(new XZRectangle(123, 423, 147, 412, 554, light)));
+    list.push_back(arena.make<BVH>(boxList, 0, 1, rng, arena));
+    MaterialId light = scene.materials.add(DiffuseLight(arena.make<ConstantTexture>(Vector3(6, 6, 6))));
+    list.push_back(arena.make<FlipNormals>(arena.make<XZRectangle>(123, 423, 147, 412, 554, light)));
     Vector3 center(400, 400, 200);
-    list.push_back(new MovingSphere(center, center+Vector3(30, 0, 0), 0, 1, 50, new Lambertian(new ConstantTexture(Vector3(0.7, 0.3, 0.1)))));
-    list.push_back(new Sphere(Vector3(260, 150, 45), 50, new Dielectric(1.5)));
-    list.push_back(new Sphere(Vector3(0, 150, 145), 50, new Metal(Vector3(0.8, 0.8, 0.9), 10)));
-    Hitable* boundary = new Sphere(Vector3(360, 150, 145), 70, new Dielectric(1.5));
+    list.push_back(arena.make<MovingSphere>(center, center+Vector3(30, 0, 0), 0, 1, 50, scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.7, 0.3, 0.1))))));
+    list.push_back(arena.make<Sphere>(Vector3(260, 150, 45), 50, scene.materials.add(Dielectric(1.5))));
+    list.push_back(arena.make<Sphere>(Vector3(0, 150, 145), 50, scene.materials.add(Metal(Vector3(0.8, 0.8, 0.9), 10))));
+    Hitable* boundary = arena.make<Sphere>(Vector3(360, 150, 145), 70, scene.materials.add(Dielectric(1.5)));
     list.push_back(boundary);
-    list.push_back(new ConstantMedium(boundary, 0.02, new ConstantTexture(Vector3(0.2, 0.4, 0.9))));
-    boundary = new Sphere(Vector3(0, 0, 0), 5000, new Dielectric(1.5));
-    list.push_back(new ConstantMedium(boundary, 0.0001, new ConstantTexture(Vector3(1.0, 1.0, 1.0))));
-    int nx, ny, nz;
-    unsigned char* tex_data = stbi_load("earthmap.jpg", &nx, &ny, &nz, 0);
-    Material* emat = new Lambertian(new ImageTexture(tex_data, nx, ny));
-    list.push_back(new Sphere(Vector3(400, 200, 400), 100, emat));
-    Texture* pertext = new NoiseTexture(0.1);
-    list.push_back(new Sphere(Vector3(220, 280, 300), 80, new Lambertian(pertext)));
+    list.push_back(arena.make<ConstantMedium>(boundary, 0.02, scene.materials.add(Isotropic(arena.make<ConstantTexture>(Vector3(0.2, 0.4, 0.9))))));
+    boundary = arena.make<Sphere>(Vector3(0, 0, 0), 5000, scene.materials.add(Dielectric(1.5)));
+    list.push_back(arena.make<ConstantMedium>(boundary, 0.0001, scene.materials.add(Isotropic(arena.make<ConstantTexture>(Vector3(1.0, 1.0, 1.0))))));
+    ThreadPool::instance().wait(textureLoad);
+    if (earth == nullptr)
+    {
+        std::cerr << error << std::endl;
+        return nullptr;
+    }
+    MaterialId emat = scene.materials.add(Lambertian(earth));
+    list.push_back(arena.make<Sphere>(Vector3(400, 200, 400), 100, emat));
+    Texture* pertext = arena.make<NoiseTexture>(0.1);
+    list.push_back(arena.make<Sphere>(Vector3(220, 280, 300), 80, scene.materials.add(Lambertian(pertext))));
     int ns = 1000;
     for (int j = 0; j < ns; j++)
     {
-        boxList2.push_back(new Sphere(Vector3(165*drand48(), 165*drand48(), 165*drand48()), 10, white));
+        boxList2.push_back(arena.make<Sphere>(Vector3(165*rng.nextDouble(), 165*rng.nextDouble(), 165*rng.nextDouble()), 10, white));
     }
-    list.push_back(new Translate(new RotateY(new BVH(boxList2, 0.0, 1.0), 15), Vector3(-100, 270, 395)));
+    list.push_back(arena.make<Translate>(arena.make<RotateY>(arena.make<BVH>(boxList2, 0.0, 1.0, rng, arena), 15), Vector3(-100, 270, 395)));
+
+    return arena.make<HitableList>(list);
+}
 
-    lights.push_back(new XZRectangle(123, 423, 147, 412, 554, nullptr));
-    //lights.push_back(new Sphere(Vector3(360, 150, 145), 70, nullptr));
-    //lights.push_back(new Sphere(Vector3(0, 0, 0), 5000, nullptr));
+Hitable* manyLights(double aspect, Camera& camera, Random& rng, Scene& scene, Arena& arena)
+{
+    const Vector3 lookFrom(0, 12, 26);
+    const Vector3 lookAt(0, 0, 0);
+    const double dist_to_focus = 10.0;
+    const double aperture = 0.0;
+    camera = Camera(lookFrom, lookAt, Vector3(0, 1, 0), 40, aspect, aperture, dist_to_focus);
 
-    return new HitableList(list);
+    std::vector<Hitable*> list;
+    list.push_back(arena.make<Sphere>(Vector3(0, -1000, 0), 1000, scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.5, 0.5, 0.5))))));
+    list.push_back(arena.make<Sphere>(Vector3(-4, 2, 0), 2, scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.7, 0.3, 0.1))))));
+    list.push_back(arena.make<Sphere>(Vector3(0, 2, 0), 2, scene.materials.add(Metal(Vector3(0.8, 0.8, 0.9), 0.2))));
+    list.push_back(arena.make<Sphere>(Vector3(4, 2, 0), 2, scene.materials.add(Lambertian(arena.make<ConstantTexture>(Vector3(0.1, 0.3, 0.7))))));
+
+    // A grid of small, dim lights with a handful of bright ones mixed in.
+    std::vector<Hitable*> lightList;
+    for (int i = 0; i < 32; i++)
+    {
+        for (int j = 0; j < 32; j++)
+        {
+            Vector3 center(-16 + i + 0.8 * rng.nextDouble(), 0.15 + 3 * rng.nextDouble(), -16 + j + 0.8 * rng.nextDouble());
+            if ((center - Vector3(center.x(), 2, 0)).length() < 2.5 && fabs(center.x()) < 7)
+                continue;
+            double strength = (rng.nextDouble() < 0.02) ? 40 : 2;
+            Vector3 color(0.2 + 0.8 * rng.nextDouble(), 0.2 + 0.8 * rng.nextDouble(), 0.2 + 0.8 * rng.nextDouble());
+            lightList.push_back(arena.make<Sphere>(center, 0.15, scene.materials.add(DiffuseLight(arena.make<ConstantTexture>(strength * color)))));
+        }
+    }
+    list.push_back(arena.make<BVH>(lightList, 0, 1, rng, arena));
+
+    return arena.make<HitableList>(list);
 }
 
+typedef Hitable* (*SceneFunction)(double aspect, Camera& camera, Random& rng, Scene& scene, Arena& arena);
+
+static const struct
+{
+    const char* name;
+    SceneFunction build;
+} g_builtinScenes[] = {
+    {"twoSpheres", twoSpheres},
+    {"randomScene", randomScene},
+    {"perlinSpheres", perlinSpheres},
+    {"simpleLight", simpleLight},
+    {"cornellBox", cornellBox},
+    {"cornellBoxTris", cornellBoxTris},
+    {"final", final},
+    {"manyLights", manyLights}
+};
+
 inline Vector3 deNan(const Vector3& c) {
     Vector3 temp = c;
     if (!(temp[0] == temp[0])) temp[0] = 0;
@@ -407,8 +533,62 @@ inline Vector3 deNan(const Vector3& c) {
     return temp;
 }
 
+// '<first>:<last>', or a single frame.
+bool parseFrameRange(const std::string& range, int& first, int& last)
+{
+    char* end;
+    first = int(strtol(range.c_str(), &end, 10));
+    if (end == range.c_str())
+        return false;
+    last = first;
+    if (*end == '\0')
+        return true;
+    if (*end != ':')
+        return false;
+    const char* start = end + 1;
+    last = int(strtol(start, &end, 10));
+    return end != start && *end == '\0' && last >= first;
+}
+
+// The output file of an animation frame: the frame number, zero padded, in
+// place of the last run of '#'s in the name, or before the extension.
+std::string frameFileName(const std::string& outFile, int frame)
+{
+    std::string number = std::to_string(frame);
+    const auto hashEnd = outFile.find_last_of('#');
+    if (hashEnd != std::string::npos)
+    {
+        auto hashStart = hashEnd;
+        while (hashStart > 0 && outFile[hashStart - 1] == '#')
+            hashStart--;
+        const size_t width = hashEnd - hashStart + 1;
+        if (number.size() < width)
+            number.insert(0, width - number.size(), '0');
+        return outFile.substr(0, hashStart) + number + outFile.substr(hashEnd + 1);
+    }
+    if (number.size() < 4)
+        number.insert(0, 4 - number.size(), '0');
+    const auto dot = outFile.rfind('.');
+    if (dot == std::string::npos || outFile.find('/', dot) != std::string::npos)
+        return outFile + "_" + number;
+    return outFile.substr(0, dot) + "_" + number + outFile.substr(dot);
+}
+
+// Where --tiletexture writes the tiled texture of an image: beside it, with
+// the extension replaced by .tiles.
+std::string tiledFileName(const std::string& image)
+{
+    const auto dot = image.rfind('.');
+    if (dot == std::string::npos || image.find('/', dot) != std::string::npos)
+        return image + ".tiles";
+    return image.substr(0, dot) + ".tiles";
+}
+
+// Pixel conversion and formatting are split over the thread pool by row;
+// the encoders themselves are serial.
 void writeImage(const std::string& outFile, const Vector3* outImage, int nx, int ny)
 {
+    ThreadPool& pool = ThreadPool::instance();
     auto extStart = outFile.rfind('.');
     if (extStart != std::string::npos)
     {
@@ -421,37 +601,56 @@ void writeImage(const std::string& outFile, const Vector3* outImage, int nx, int
             {
                 of << "P3\n" << nx << " " << ny << "\n255\n";
 
-                for (int i = 0; i < nx * ny; i++)
+                std::vector<std::string> rows(ny);
+                pool.parallelFor(0, ny, [&](int j)
                 {
-                    Vector3 col = outImage[i];
+                    std::string& row = rows[j];
+                    for (int i = j * nx; i < (j + 1) * nx; i++)
+                    {
+                        Vector3 col = outImage[i];
 
-                    int ir = int(255.99 * col[0]);
-                    int ig = int(255.99 * col[1]);
-                    int ib = int(255.99 * col[2]);
+                        int ir = int(255.99 * col[0]);
+                        int ig = int(255.99 * col[1]);
+                        int ib = int(255.99 * col[2]);
 
-                    of << ir << " " << ig << " " << ib << "\n";
-                }
+                        row += std::to_string(ir) + " " + std::to_string(ig) + " " + std::to_string(ib) + "\n";
+                    }
+                }, 16);
+                for (const auto& row : rows)
+                    of << row;
             }
             of.close();
         }
         else if (ext == "hdr")
         {
-            stbi_write_hdr(outFile.c_str(), nx, ny, 3, (const float*)outImage);
+            std::vector<float> outFloats(size_t(nx) * ny * 3);
+            pool.parallelFor(0, ny, [&](int j)
+            {
+                for (int i = j * nx; i < (j + 1) * nx; i++)
+                {
+                    for (int c = 0; c < 3; c++)
+                        outFloats[3 * i + c] = float(outImage[i][c]);
+                }
+            }, 16);
+            stbi_write_hdr(outFile.c_str(), nx, ny, 3, outFloats.data());
         }
         else
         {
             unsigned char* outBytes = new unsigned char[nx * ny * 3];
-            unsigned char* currentOut = outBytes;
-            for (int i = 0; i < nx * ny; i++)
+            pool.parallelFor(0, ny, [&](int j)
             {
-                const Vector3& col = outImage[i];
-                int ir = clamp(int(255.99 * col[0]), 0, 255);
-                int ig = clamp(int(255.99 * col[1]), 0, 255);
-                int ib = clamp(int(255.99 * col[2]), 0, 255);
-                *currentOut++ = (unsigned char)ir;
-                *currentOut++ = (unsigned char)ig;
-                *currentOut++ = (unsigned char)ib;
-            }
+                unsigned char* currentOut = outBytes + j * nx * 3;
+                for (int i = j * nx; i < (j + 1) * nx; i++)
+                {
+                    const Vector3& col = outImage[i];
+                    int ir = clamp(int(255.99 * col[0]), 0, 255);
+                    int ig = clamp(int(255.99 * col[1]), 0, 255);
+                    int ib = clamp(int(255.99 * col[2]), 0, 255);
+                    *currentOut++ = (unsigned char)ir;
+                    *currentOut++ = (unsigned char)ig;
+                    *currentOut++ = (unsigned char)ib;
+                }
+            }, 16);
             if (ext == "png")
                 stbi_write_png(outFile.c_str(), nx, ny, 3, outBytes, nx * 3);
             else if (ext == "tga")
@@ -464,21 +663,292 @@ void writeImage(const std::string& outFile, const Vector3* outImage, int nx, int
     }
 }
 
-void renderLine(int line, Vector3* outLine, int nx, int ny, int ns, Camera& cam, Hitable* world, Hitable* lightShapes)
+struct RenderSettings
+{
+    int nx = 800;
+    int ny = 800;
+    int ns = 100 * 100;         // samples per pixel, the per-pixel cap when adaptive
+    int rrDepth = 3;
+    bool powerHeuristic = true;
+    double noiseTarget = 0;     // adaptive sampling when > 0
+    int minSamples = 16;        // first pass of adaptive and progressive renders
+    bool progressive = false;   // passes of doubling sample count
+    double timeBudget = 0;      // seconds, progressive renders stop within it
+    double checkpointInterval = 0;  // seconds between intermediate images
+    int tileSize = 16;
+    TileScheduler::Order tileOrder = TileScheduler::Order::Hilbert;
+    std::string samplerName = "random";
+    uint64_t seed = 0;          // of the sampler streams
+    uint64_t sceneSeed = 0;     // of procedural scene content, independent of the sampler
+    bool deterministic = false;
+    int numThreads = 0;         // 0 uses every CPU
+    bool pinThreads = false;
+    bool numa = false;          // threads, scene and framebuffer placed per NUMA node
+    bool wavefront = false;     // breadth-first integrator, see Wavefront.h
+    int wavefrontSize = 1 << 16;    // paths per wavefront batch
+    bool sortRays = false;      // wavefront rays sorted by direction and origin
+    bool sortHits = false;      // wavefront hits sorted by material
+    bool cameraPackets = false; // wavefront camera rays traced as 8x8 packets
+};
+
+//
+// Running mean and variance of the luminance of a pixel's samples.
+//
+// B. P. Welford, "Note on a Method for Calculating Corrected Sums of Squares
+// and Products", Technometrics 4(3), 1962.
+//
+struct PixelStatistics
+{
+    void add(double x)
+    {
+        n++;
+        const double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+
+    double variance() const { return (n > 1) ? m2 / (n - 1) : 0; }
+
+    // Standard error of the displayed (gamma 2) pixel value; zero once the
+    // pixel is certain to be clipped to white.
+    double displayError() const
+    {
+        const double stdError = sqrt(variance() / n);
+        if (mean - 3 * stdError > 1)
+            return 0;
+        if (stdError == 0)
+            return 0;
+        return stdError / (2 * sqrt(std::max(mean, 1e-8)));
+    }
+
+    int n = 0;
+    double mean = 0;
+    double m2 = 0;
+};
+
+struct PixelSamples
+{
+    Vector3 sum{0, 0, 0};
+    PixelStatistics stats;
+    int target = 0;     // sample count to reach in the current pass
+};
+
+// The spread of the ray cones that filter textures, see color_nr.  The
+// samples of a pixel already average over it, so the cone of each covers
+// a share of the pixel, as with ray differentials in pbrt.
+double coneSpread(const Camera& cam, const RenderSettings& settings)
+{
+    return cam.pixelSpread(settings.ny) * std::max(0.125, 1 / sqrt(double(std::max(1, settings.ns))));
+}
+
+// Brings every pixel of the tile up to its target sample count.  Returns the
+// total number of path vertices traced.
+long long renderTile(const Tile& tile, std::vector<PixelSamples>& pixels, const RenderSettings& settings,
+                     const Camera& cam, const Scene& scene, Hitable* world, Hitable* lightShapes, Sampler& sampler,
+                     long long& samples)
+{
+    const double spread = coneSpread(cam, settings);
+    long long vertices = 0;
+    for (int j = tile.y0; j < tile.y1; j++)
+    {
+        const int line = settings.ny - j - 1;
+        for (int x = tile.x0; x < tile.x1; x++)
+        {
+            PixelSamples& pixel = pixels[j * settings.nx + x];
+            samples += std::max(0, pixel.target - pixel.stats.n);
+            for (int s = pixel.stats.n; s < pixel.target; s++)
+            {
+                sampler.startSample(x, line, s);
+                Vector2 jitter = sampler.get2D();
+                auto u = (x+jitter.x())/double(settings.nx);
+                auto v = (line+jitter.y())/double(settings.ny);
+                Ray r = cam.getRay(u, v, sampler);
+                int pathLength = 0;
+                Vector3 sample = deNan(color_nr(r, spread, scene, world, lightShapes, sampler, settings.rrDepth, settings.powerHeuristic, pathLength));
+                pixel.sum += sample;
+                pixel.stats.add(luminance(sample));
+                vertices += pathLength;
+            }
+        }
+    }
+    return vertices;
+}
+
+// renderTile with the wavefront integrator: the tile's samples are traced in
+// batches of settings.wavefrontSize paths and summed into the pixels in the
+// same order.
+long long renderTileWavefront(const Tile& tile, std::vector<PixelSamples>& pixels, const RenderSettings& settings,
+                              WavefrontIntegrator& integrator, Sampler& sampler, long long& samples)
 {
-    for (int x = 0; x < nx; x++)
+    long long vertices = 0;
+    std::vector<WavefrontIntegrator::PathRequest> batch;
+    std::vector<PixelSamples*> batchPixels;
+    auto flush = [&]()
     {
-        Vector3 col(0, 0, 0);
-        for (int s = 0; s<ns; s++)
+        integrator.render(batch, sampler);
+        for (size_t i = 0; i < batch.size(); i++)
         {
-            auto u = (x+drand48())/double(nx);
-            auto v = (line+drand48())/double(ny);
-            Ray r = cam.getRay(u, v);
-            col += deNan(color_nr(r, world, lightShapes));
+            Vector3 sample = deNan(integrator.radiance(i));
+            batchPixels[i]->sum += sample;
+            batchPixels[i]->stats.add(luminance(sample));
+            vertices += integrator.pathLength(i);
         }
-        col /= double(ns);
-        outLine[x] = Vector3(sqrt(std::max(0.0, col[0])), sqrt(std::max(0.0, col[1])), sqrt(std::max(0.0, col[2])));
+        batch.clear();
+        batchPixels.clear();
+    };
+
+    for (int j = tile.y0; j < tile.y1; j++)
+    {
+        const int line = settings.ny - j - 1;
+        for (int x = tile.x0; x < tile.x1; x++)
+        {
+            PixelSamples& pixel = pixels[j * settings.nx + x];
+            samples += std::max(0, pixel.target - pixel.stats.n);
+            for (int s = pixel.stats.n; s < pixel.target; s++)
+            {
+                batch.push_back({x, line, s});
+                batchPixels.push_back(&pixel);
+                if (int(batch.size()) >= settings.wavefrontSize)
+                    flush();
+            }
+        }
+    }
+    if (!batch.empty())
+        flush();
+    return vertices;
+}
+
+//
+// Choose the pixels for the next progressive pass and double their sample
+// count, up to the cap.  When sampling adaptively only pixels above the noise
+// target are chosen.  A pixel's error is the largest estimate in its 3x3
+// neighbourhood, so a firefly that a few samples happened to miss is still
+// caught through its neighbours.  Returns the number of pixels selected.
+//
+int selectPassPixels(std::vector<PixelSamples>& pixels, const RenderSettings& settings)
+{
+    const int nx = settings.nx;
+    const int ny = settings.ny;
+    std::vector<double> error(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++)
+        error[i] = pixels[i].stats.displayError();
+
+    int active = 0;
+    for (int j = 0; j < ny; j++)
+    {
+        for (int i = 0; i < nx; i++)
+        {
+            PixelSamples& pixel = pixels[j * nx + i];
+            if (pixel.stats.n >= settings.ns)
+                continue;
+
+            double maxError = 0;
+            for (int dj = std::max(0, j - 1); dj <= std::min(ny - 1, j + 1); dj++)
+                for (int di = std::max(0, i - 1); di <= std::min(nx - 1, i + 1); di++)
+                    maxError = std::max(maxError, error[dj * nx + di]);
+
+            if (settings.noiseTarget <= 0 || maxError > settings.noiseTarget)
+            {
+                pixel.target = std::min(settings.ns, 2 * pixel.stats.n);
+                active++;
+            }
+        }
+    }
+    return active;
+}
+
+// Shrink the pass just selected to a fraction of its samples, keeping at
+// least one per selected pixel.  Returns the number of samples in the pass.
+long long scalePass(std::vector<PixelSamples>& pixels, double fraction)
+{
+    long long samples = 0;
+    for (auto& pixel : pixels)
+    {
+        if (pixel.target > pixel.stats.n)
+        {
+            pixel.target = pixel.stats.n + int(ceil((pixel.target - pixel.stats.n) * fraction));
+            samples += pixel.target - pixel.stats.n;
+        }
+    }
+    return samples;
+}
+
+long long passSamples(const std::vector<PixelSamples>& pixels)
+{
+    long long samples = 0;
+    for (const auto& pixel : pixels)
+        samples += std::max(0, pixel.target - pixel.stats.n);
+    return samples;
+}
+
+// Gamma corrected pixel averages.
+void resolveImage(const std::vector<PixelSamples>& pixels, Vector3* outImage)
+{
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        const PixelSamples& pixel = pixels[i];
+        const Vector3 col = pixel.sum / double(std::max(1, pixel.stats.n));
+        outImage[i] = Vector3(sqrt(std::max(0.0, col[0])), sqrt(std::max(0.0, col[1])), sqrt(std::max(0.0, col[2])));
+    }
+}
+
+// Per render thread totals for the utilization report, padded so threads
+// never share a cache line.
+struct alignas(64) ThreadStatistics
+{
+    double busySeconds = 0;
+    long long tiles = 0;
+    long long samples = 0;
+    long long vertices = 0;
+};
+
+// Renders every pixel up to its target sample count, one task per pool
+// thread taking tiles from the scheduler until none are left.
+void renderPass(std::vector<PixelSamples>& pixels, const RenderSettings& settings, const Camera& cam,
+                     const Scene& scene, Hitable* world, Hitable* lightShapes, TileScheduler& scheduler,
+                     std::vector<ThreadStatistics>& threadStats, Progress* progress)
+{
+    scheduler.reset();
+    ThreadPool& pool = ThreadPool::instance();
+    ThreadPool::TaskGroup group;
+    for (int t = 0; t < pool.numThreads(); t++)
+    {
+        pool.run(group, [&]()
+        {
+            ThreadStatistics& stats = threadStats[ThreadPool::threadIndex()];
+            // Wavefront paths advance in turn, so each needs a random stream of
+            // its own rather than the pixel's.
+            std::unique_ptr<Sampler> sampler(Sampler::create(settings.samplerName, settings.nx, settings.seed,
+                                                             settings.deterministic || settings.wavefront));
+            std::unique_ptr<WavefrontIntegrator> integrator;
+            if (settings.wavefront)
+            {
+                WavefrontIntegrator::Options options;
+                options.rrDepth = settings.rrDepth;
+                options.powerHeuristic = settings.powerHeuristic;
+                options.sortRays = settings.sortRays;
+                options.sortHits = settings.sortHits;
+                options.cameraPackets = settings.cameraPackets;
+                options.coneSpread = coneSpread(cam, settings);
+                integrator.reset(new WavefrontIntegrator(cam, scene, world, lightShapes, settings.nx, settings.ny, options));
+            }
+            Tile tile{};
+            while (scheduler.next(tile, ThreadPool::threadNode()))
+            {
+                const auto tileStart = std::chrono::steady_clock::now();
+                if (integrator)
+                    stats.vertices += renderTileWavefront(tile, pixels, settings, *integrator, *sampler, stats.samples);
+                else
+                    stats.vertices += renderTile(tile, pixels, settings, cam, scene, world, lightShapes, *sampler, stats.samples);
+                stats.busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - tileStart).count();
+                stats.tiles++;
+
+                if (progress != nullptr)
+                    progress->update((tile.x1 - tile.x0) * (tile.y1 - tile.y0));
+            }
+        });
     }
+    pool.wait(group);
 }
 
 int main(int argc, char** argv)
@@ -489,75 +959,439 @@ int main(int argc, char** argv)
         ("w,width", "Output width.", cxxopts::value<int>())
         ("h,height", "Output height.", cxxopts::value<int>())
         ("n,numsamples", "Number of sample rays per pixel.", cxxopts::value<int>())
-        ("t,threads", "Number of render threads.", cxxopts::value<int>())
+        ("t,threads", "Number of threads, by default one per CPU.", cxxopts::value<int>())
+        ("pin", "Pin each thread to its own CPU.")
+        ("numa", "NUMA-aware render: threads split over the nodes, scene memory interleaved and each "
+                 "node's band of the image stored on it.")
+        ("wavefront", "Trace paths breadth first, a bounce of a whole batch of paths at a time.")
+        ("wavefrontsize", "Paths per wavefront batch.", cxxopts::value<int>())
+        ("packets", "Wavefront: trace camera rays as packets of 8x8 pixels.")
+        ("sort", "Wavefront: sort rays before tracing, hits by material before shading, or both: "
+                 "rays, materials or all.", cxxopts::value<std::string>())
+        ("d,deterministic", "Deterministic render, identical for any thread count, tile order or machine.")
+        ("seed", "Random seed of the sample streams.", cxxopts::value<uint64_t>())
+        ("sceneseed", "Random seed of the procedural scenes' geometry and materials.", cxxopts::value<uint64_t>())
+        ("s,sampler", "Sample generator: random, sobol or bluenoise.", cxxopts::value<std::string>())
+        ("rrdepth", "Bounces before Russian roulette may end a path (-1 disables).", cxxopts::value<int>())
+        ("mis", "Light/BSDF sample weighting heuristic: power or balance.", cxxopts::value<std::string>())
+        ("noise", "Adaptive sampling: per-pixel noise target (standard error of the 0-1 display value).  "
+                  "The sample count becomes the per-pixel maximum.", cxxopts::value<double>())
+        ("minspp", "Samples per pixel of the first adaptive or progressive pass.", cxxopts::value<int>())
+        ("p,progressive", "Progressive render: passes of doubling sample count over the whole image.")
+        ("time", "Progressive render time budget, in seconds.", cxxopts::value<double>())
+        ("checkpoint", "Progressive render: write the image every this many seconds.", cxxopts::value<double>())
+        ("tilesize", "Edge length of the square tiles handed to render threads.", cxxopts::value<int>())
+        ("tileorder", "Tile order: hilbert, spiral or scanline.", cxxopts::value<std::string>())
+        ("scene", "Scene file, see SceneParser.h, compiled scene package, or a built-in scene: twoSpheres, "
+                  "randomScene, perlinSpheres, simpleLight, cornellBox, cornellBoxTris, final (the default) or "
+                  "manyLights.", cxxopts::value<std::string>())
+        ("compile", "Write the scene to this file as a compiled package, see ScenePackage.h, and exit.",
+                    cxxopts::value<std::string>())
+        ("tiletexture", "Convert this image to a tiled texture, see TextureCache.h, written beside it with the "
+                        "extension .tiles, and exit.", cxxopts::value<std::string>())
+        ("texturecache", "Megabytes of tiled texture held in memory.", cxxopts::value<int>())
+        ("frames", "Render frames <first>:<last> of the scene's animation, each to the output file with the "
+                   "frame number in place of its last run of '#'s, or before the extension.",
+                   cxxopts::value<std::string>())
         ("f,file", "Output filename.", cxxopts::value<std::string>());
 
     options.parse(argc, argv);
 
+    const auto startTime = std::chrono::steady_clock::now();
+    auto elapsedSeconds = [startTime]()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    };
+
+    if (options.count("tiletexture"))
+    {
+        const std::string image = options["tiletexture"].as<std::string>();
+        const std::string tiled = tiledFileName(image);
+        int width, height, channels;
+        unsigned char* pixels = stbi_load(image.c_str(), &width, &height, &channels, 3);
+        if (pixels == nullptr)
+        {
+            std::cerr << "Unable to read image '" << image << "'." << std::endl;
+            return 1;
+        }
+        std::string error;
+        const bool written = TiledImage::write(tiled, pixels, width, height, error);
+        stbi_image_free(pixels);
+        if (!written)
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote tiled texture " << tiled << "." << std::endl;
+        return 0;
+    }
+
     bool quick = options.count("quick") > 0;
 
-    int nx = 800;
-    int ny = 800;
-    int ns = 100 * 100;
-    int numThreads = 1;
+    RenderSettings settings;
+    settings.deterministic = options.count("deterministic") > 0;
+    settings.pinThreads = options.count("pin") > 0;
+    settings.numa = options.count("numa") > 0;
+    settings.wavefront = options.count("wavefront") > 0;
+    if (options.count("wavefrontsize"))
+        settings.wavefrontSize = std::max(1, options["wavefrontsize"].as<int>());
+    if (options.count("packets"))
+    {
+        settings.cameraPackets = true;
+        settings.wavefront = true;
+    }
+    if (options.count("sort"))
+    {
+        const std::string sort = options["sort"].as<std::string>();
+        if (sort != "rays" && sort != "materials" && sort != "all")
+        {
+            std::cerr << "Unknown sort: " << sort << std::endl;
+            return 1;
+        }
+        settings.sortRays = (sort != "materials");
+        settings.sortHits = (sort != "rays");
+        settings.wavefront = true;
+    }
 
     std::string outFile("outputImage.ppm");
+    std::string sceneName("final");
+    std::string packagePath;
+    bool animation = false;
+    int firstFrame = 0, lastFrame = 0;
 
     if (options.count("width"))
-        nx = options["width"].as<int>();
+        settings.nx = options["width"].as<int>();
     if (options.count("height"))
-        ny = options["height"].as<int>();
+        settings.ny = options["height"].as<int>();
     if (options.count("numsamples"))
-        ns = options["numsamples"].as<int>();
+        settings.ns = options["numsamples"].as<int>();
     if (options.count("file"))
         outFile = options["file"].as<std::string>();
+    if (options.count("scene"))
+        sceneName = options["scene"].as<std::string>();
+    if (options.count("compile"))
+        packagePath = options["compile"].as<std::string>();
+    if (options.count("frames"))
+    {
+        const std::string frames = options["frames"].as<std::string>();
+        if (!parseFrameRange(frames, firstFrame, lastFrame))
+        {
+            std::cerr << "Invalid frame range: " << frames << std::endl;
+            return 1;
+        }
+        animation = true;
+    }
+    if (options.count("texturecache"))
+        TextureCache::instance().setCapacity(size_t(std::max(1, options["texturecache"].as<int>())) << 20u);
     if (options.count("threads"))
-        numThreads = options["numthreads"].as<int>();
+        settings.numThreads = options["threads"].as<int>();
+    if (options.count("seed"))
+        settings.seed = options["seed"].as<uint64_t>();
+    if (options.count("sceneseed"))
+        settings.sceneSeed = options["sceneseed"].as<uint64_t>();
+    if (options.count("rrdepth"))
+        settings.rrDepth = options["rrdepth"].as<int>();
+    if (options.count("mis"))
+    {
+        const std::string heuristic = options["mis"].as<std::string>();
+        if (heuristic != "power" && heuristic != "balance")
+        {
+            std::cerr << "Unknown MIS heuristic: " << heuristic << std::endl;
+            return 1;
+        }
+        settings.powerHeuristic = (heuristic == "power");
+    }
+    if (options.count("noise"))
+        settings.noiseTarget = options["noise"].as<double>();
+    if (options.count("minspp"))
+        settings.minSamples = std::max(1, options["minspp"].as<int>());
+    if (options.count("sampler"))
+        settings.samplerName = options["sampler"].as<std::string>();
+    if (options.count("time"))
+        settings.timeBudget = options["time"].as<double>();
+    if (options.count("checkpoint"))
+        settings.checkpointInterval = options["checkpoint"].as<double>();
+    if (options.count("tilesize"))
+        settings.tileSize = std::max(1, options["tilesize"].as<int>());
+    if (options.count("tileorder"))
+    {
+        const std::string order = options["tileorder"].as<std::string>();
+        if (!TileScheduler::parseOrder(order, settings.tileOrder))
+        {
+            std::cerr << "Unknown tile order: " << order << std::endl;
+            return 1;
+        }
+    }
+    settings.progressive = options.count("progressive") || settings.timeBudget > 0 || settings.checkpointInterval > 0;
+    if (settings.deterministic && settings.timeBudget > 0)
+    {
+        // Where a wall-clock budget ends depends on the machine.
+        std::cerr << "Time budget ignored in deterministic mode." << std::endl;
+        settings.timeBudget = 0;
+    }
+
+    if (!std::unique_ptr<Sampler>(Sampler::create(settings.samplerName, settings.nx, settings.seed, settings.deterministic)))
+    {
+        std::cerr << "Unknown sampler: " << settings.samplerName << std::endl;
+        return 1;
+    }
 
     if (quick)
     {
-        nx /= 8;
-        ny /= 8;
-        ns /= 16;
+        settings.nx /= 8;
+        settings.ny /= 8;
+        settings.ns /= 16;
+        settings.minSamples = std::max(1, settings.minSamples / 16);
+    }
+
+    ThreadPool::Affinity affinity = ThreadPool::Affinity::None;
+    if (settings.numa)
+    {
+        if (Numa::available())
+            std::cout << "NUMA nodes: " << Numa::numNodes() << std::endl;
+        else
+            std::cerr << "NUMA support not available, rendering as a single node." << std::endl;
+        affinity = ThreadPool::Affinity::Node;
+    }
+    else if (settings.pinThreads)
+    {
+        affinity = ThreadPool::Affinity::Cpu;
     }
+    ThreadPool::configure(settings.numThreads, affinity);
 
     Camera cam;
+    CameraPath cameraPath;
+    const int nx = settings.nx;
+    const int ny = settings.ny;
     const double aspect = double(nx)/double(ny);
+
+    // The scene is read by every thread, so in NUMA mode its pages are spread
+    // evenly over the nodes rather than all landing on the main thread's.
+    // BVH subtrees built by pool tasks go to the building thread's node.
+    if (settings.numa)
+        Numa::interleaveAllocations(true);
+    Arena sceneArena;
+    Scene* scene = sceneArena.make<Scene>();
+    // Seeded apart from the sampler, so --seed gives another noise pattern
+    // over the same scene.
+    Random sceneRandom(0, settings.sceneSeed);
+    Hitable* world = nullptr;
+    bool builtin = false;
+    for (const auto& builtinScene : g_builtinScenes)
+    {
+        if (sceneName == builtinScene.name)
+        {
+            // A built-in scene reports its own errors.
+            world = builtinScene.build(aspect, cam, sceneRandom, *scene, sceneArena);
+            if (world == nullptr)
+                return 1;
+            builtin = true;
+        }
+    }
+    if (!builtin)
+    {
+        std::string error;
+        if (isScenePackage(sceneName))
+            world = loadScenePackage(sceneName, aspect, cam, *scene, sceneArena, error);
+        else
+            world = loadScene(sceneName, aspect, cam, sceneRandom, *scene, sceneArena, error, &cameraPath);
+        if (world == nullptr)
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "Scene ready: " << elapsedSeconds() << " s" << std::endl;
+
+    if (!packagePath.empty())
+    {
+        std::string error;
+        ScenePackageWriter writer;
+        if (!writer.write(packagePath, world, cam, *scene, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote scene package " << packagePath << "." << std::endl;
+        return 0;
+    }
+
+    // Every emissive surface in the scene is sampled for direct lighting.
     std::vector<Hitable*> lights;
-    Hitable* world = final(aspect, cam, lights);// cornellBox(); // simpleLight(); //randomScene(); //
-    HitableList* lightShapes = nullptr;
+    world->collectLights(lights, scene->materials, sceneArena);
+    Hitable* lightShapes = nullptr;
     if (!lights.empty())
-        lightShapes = new HitableList(lights);
-    //Hitable* lightShape = new XZRectangle(213, 343, 227, 332, 554, nullptr);
-    //Hitable* glassSphere = new Sphere(Vector3(190, 90, 190), 90, nullptr);
-    //lights.push_back(lightShape);
-    //lights.push_back(glassSphere);
-    //HitableList* lightShapes = new HitableList(lights);
+        lightShapes = sceneArena.make<LightTree>(lights, scene->materials);
+    if (settings.numa)
+        Numa::interleaveAllocations(false);
+    std::cout << "Lights: " << lights.size() << std::endl;
 
     int numHitables = world->numChildren();
     std::cout << "Total Hitables: " << numHitables << std::endl;
+    std::cout << "Scene memory: " << sceneArena.bytesAllocated() / 1024 << " KB" << std::endl;
+
+    const bool adaptive = settings.noiseTarget > 0;
+    const bool multiPass = adaptive || settings.progressive;
+    TileScheduler scheduler(nx, ny, settings.tileSize, settings.tileOrder, settings.numa ? Numa::numNodes() : 1);
+
+    // Each band of rows is stored on the node whose threads take its tiles
+    // first.  The placement holds for pages not yet touched, so it is set
+    // before the pixels are initialized.
+    std::vector<PixelSamples> pixels;
+    pixels.reserve(size_t(nx) * ny);
+    if (settings.numa)
+    {
+        for (int band = 0; band < scheduler.numBands(); band++)
+        {
+            const size_t first = size_t(scheduler.bandFirstRow(band)) * nx;
+            const size_t last = size_t(scheduler.bandLastRow(band)) * nx;
+            Numa::placeOnNode(pixels.data() + first, (last - first) * sizeof(PixelSamples), band);
+        }
+    }
+    pixels.resize(size_t(nx) * ny);
+    for (auto& pixel : pixels)
+        pixel.target = multiPass ? std::min(settings.minSamples, settings.ns) : settings.ns;
 
     Vector3* outImage = new Vector3[nx * ny];
 
-    Progress progress(nx*ny, "PathTracers");
+    std::vector<ThreadStatistics> threadStats(static_cast<size_t>(ThreadPool::instance().numThreads()));
 
-    int index = 0;
-    #pragma omp parallel for if(numThreads)
-    for (int j = 0; j < ny; j++)
+    // Only the keyframed parts of the scene change from frame to frame; the
+    // lights are collected again if any of them moved.
+    Arena frameArena;
+    for (int frame = firstFrame; frame <= lastFrame; frame++)
     {
-        Vector3* outLine = outImage + (nx * j);
-        const int line = ny - j - 1;
-        renderLine(line, outLine, nx, ny, ns, cam, world, lightShapes);
+        const std::string frameFile = animation ? frameFileName(outFile, frame) : outFile;
+        // The time budget is per frame, the first's including the scene setup.
+        const double frameStart = (frame == firstFrame) ? 0 : elapsedSeconds();
+        if (animation)
+        {
+            const double updateStart = elapsedSeconds();
+            if (!cameraPath.keys.empty())
+                cam = cameraPath.at(frame, aspect);
+            if (world->setFrame(frame))
+            {
+                lights.clear();
+                frameArena.release();
+                world->collectLights(lights, scene->materials, frameArena);
+                lightShapes = lights.empty() ? nullptr : frameArena.make<LightTree>(lights, scene->materials);
+            }
+            std::cout << "Frame " << frame << ": " << frameFile << ", updated in "
+                      << elapsedSeconds() - updateStart << " s" << std::endl;
 
-        #pragma omp critical(progress)
+            for (auto& pixel : pixels)
+            {
+                pixel = PixelSamples();
+                pixel.target = multiPass ? std::min(settings.minSamples, settings.ns) : settings.ns;
+            }
+            std::fill(threadStats.begin(), threadStats.end(), ThreadStatistics());
+        }
+
+        const double renderStart = elapsedSeconds();
+        Progress progress(nx*ny, "PathTracers");
+        renderPass(pixels, settings, cam, *scene, world, lightShapes, scheduler, threadStats, &progress);
+        progress.completed();
+        long long totalSamples = (long long)nx * ny * pixels[0].stats.n;
+
+        if (multiPass)
         {
-            progress.update(nx);
+            std::string stopReason;
+            double lastCheckpoint = elapsedSeconds();
+            int active;
+            while ((active = selectPassPixels(pixels, settings)) > 0)
+            {
+                long long samples = passSamples(pixels);
+                if (settings.timeBudget > 0 || settings.checkpointInterval > 0)
+                {
+                    // Size the pass to end within the time budget and near the
+                    // next checkpoint, from the sample rate so far.
+                    const double samplesPerSecond = totalSamples / std::max(elapsedSeconds() - renderStart, 1e-3);
+                    double passLimit = DBL_MAX;
+                    if (settings.timeBudget > 0)
+                    {
+                        passLimit = settings.timeBudget - (elapsedSeconds() - frameStart);
+                        if (passLimit < active / samplesPerSecond)
+                        {
+                            stopReason = "time budget";
+                            break;
+                        }
+                    }
+                    if (settings.checkpointInterval > 0)
+                        passLimit = std::min(passLimit, std::max(lastCheckpoint + settings.checkpointInterval - elapsedSeconds(),
+                                                                 0.25 * settings.checkpointInterval));
+                    const double predicted = samples / samplesPerSecond;
+                    if (predicted > passLimit)
+                        samples = scalePass(pixels, passLimit / predicted);
+                }
+
+                renderPass(pixels, settings, cam, *scene, world, lightShapes, scheduler, threadStats, nullptr);
+                totalSamples += samples;
+                std::cout << (adaptive ? "Adaptive pass: " : "Progressive pass: ") << active << " pixels, "
+                          << double(totalSamples) / (double(nx) * ny) << " spp, " << elapsedSeconds() << " s" << std::endl;
+
+                if (settings.checkpointInterval > 0 && elapsedSeconds() - lastCheckpoint >= settings.checkpointInterval)
+                {
+                    resolveImage(pixels, outImage);
+                    writeImage(frameFile, outImage, nx, ny);
+                    lastCheckpoint = elapsedSeconds();
+                }
+            }
+            if (active == 0)
+                stopReason = adaptive ? "noise target or sample cap reached" : "sample count reached";
+            std::cout << "Stopped: " << stopReason << std::endl;
         }
-    }
 
-    progress.completed();
+        resolveImage(pixels, outImage);
+
+        const double renderSeconds = elapsedSeconds() - renderStart;
+        std::cout << "Render threads: " << threadStats.size() << ", " << scheduler.numTiles() << " tiles of "
+                  << settings.tileSize << "x" << settings.tileSize << ", " << renderSeconds << " s" << std::endl;
+        for (size_t t = 0; t < threadStats.size(); t++)
+        {
+            const ThreadStatistics& stats = threadStats[t];
+            std::cout << "  thread " << t;
+            if (settings.numa)
+                std::cout << " (node " << Numa::threadNode(int(t), int(threadStats.size())) << ")";
+            std::cout << ": " << stats.tiles << " tiles, " << stats.samples << " samples, "
+                      << stats.busySeconds << " s busy (" << 100.0 * stats.busySeconds / renderSeconds << "%)" << std::endl;
+        }
+
+        long long totalVertices = 0;
+        for (const auto& stats : threadStats)
+            totalVertices += stats.vertices;
+        std::cout << "Average path length: " << double(totalVertices) / double(totalSamples) << std::endl;
+        const TextureCache::Statistics textureStats = TextureCache::instance().statistics();
+        if (textureStats.images > 0)
+        {
+            std::cout << "Texture images: " << textureStats.images << " (" << textureStats.sharedImages
+                      << " repeated references shared), " << textureStats.residentBytes / 1024 << " KB loaded whole"
+                      << std::endl;
+        }
+        if (textureStats.hits + textureStats.misses > 0)
+        {
+            const uint64_t lookups = textureStats.hits + textureStats.misses;
+            std::cout << "Texture cache: " << lookups << " tile lookups, " << 100.0 * double(textureStats.hits) / double(lookups)
+                      << "% hits, " << textureStats.misses << " tiles read, " << textureStats.evictions << " evicted, peak "
+                      << textureStats.peakBytes / 1024 << " KB of " << TextureCache::instance().capacity() / 1024 << " KB";
+            if (textureStats.readErrors > 0)
+                std::cout << ", " << textureStats.readErrors << " read errors";
+            std::cout << std::endl;
+        }
+        if (adaptive)
+        {
+            const long long uniformSamples = (long long)nx * ny * settings.ns;
+            std::cout << "Adaptive sampling: " << totalSamples << " samples, " << double(totalSamples) / (double(nx) * ny)
+                      << " per pixel; saved " << uniformSamples - totalSamples << " ("
+                      << 100.0 * double(uniformSamples - totalSamples) / double(uniformSamples) << "%)" << std::endl;
+        }
+
+        writeImage(frameFile, outImage, nx, ny);
+    }
 
-    writeImage(outFile, outImage, nx, ny);
+    // The scene refers to textures in the texture cache, so it goes first.
+    frameArena.release();
+    sceneArena.release();
+    TextureCache::instance().clear();
 
     delete[] outImage;
 